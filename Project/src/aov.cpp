@@ -0,0 +1,148 @@
+//aov.cpp
+
+#include "aov.h"
+#include "parallel.h"
+#include <algorithm>
+#include <float.h>
+#include <mutex>
+
+AOVBuffer::AOVBuffer(int w, int h) :
+width(w), height(h), minDepth(0), maxDepth(0)
+{
+	std::size_t n = std::size_t(width) * height;
+	depth = new float[n];
+	normal = new float[n * 3];
+	albedo = new float[n * 3];
+	objectId = new int[n];
+	materialId = new int[n];
+}
+
+AOVBuffer::~AOVBuffer()
+{
+	delete []depth;
+	delete []normal;
+	delete []albedo;
+	delete []objectId;
+	delete []materialId;
+}
+
+void AOVBuffer::render(World *world, Camera *camera, int numThreads)
+{
+	Vector3D forward = camera->get_forward();
+	Color background = world->getBackground();
+
+	float globalMin = FLT_MAX, globalMax = -FLT_MAX;
+	std::mutex rangeMutex;
+
+	parallelFor(0, height, numThreads, [&](int rowBegin, int rowEnd) {
+		// Per-chunk depth range, merged once at the end of the chunk
+		float localMin = FLT_MAX, localMax = -FLT_MAX;
+		for(int j = rowBegin; j < rowEnd; j++)
+			for(int i = 0; i < width; i++)
+			{
+				std::size_t k = std::size_t(i) + std::size_t(j)*width;
+				Vector3D dir = camera->get_sample_direction(i, j, 0.5f, 0.5f);
+				Ray ray(camera->get_position(), dir);
+				world->firstIntersection(ray);
+
+				if(!ray.didHit())
+				{
+					depth[k] = 0.0f;
+					normal[k*3 + 0] = normal[k*3 + 1] = normal[k*3 + 2] = 0.0f;
+					albedo[k*3 + 0] = background.r;
+					albedo[k*3 + 1] = background.g;
+					albedo[k*3 + 2] = background.b;
+					objectId[k] = -1;
+					materialId[k] = -1;
+					continue;
+				}
+
+				const Object *object = ray.intersected();
+				const Material *material = object->getMaterial();
+				Vector3D n = ray.getNormal();
+				float d = ray.getParameter() * dotProduct(dir, forward);
+
+				depth[k] = d;
+				normal[k*3 + 0] = n.X();
+				normal[k*3 + 1] = n.Y();
+				normal[k*3 + 2] = n.Z();
+				albedo[k*3 + 0] = material->color.r;
+				albedo[k*3 + 1] = material->color.g;
+				albedo[k*3 + 2] = material->color.b;
+				objectId[k] = object->getId();
+				materialId[k] = material->id;
+
+				localMin = std::min(localMin, d);
+				localMax = std::max(localMax, d);
+			}
+
+		std::lock_guard<std::mutex> lock(rangeMutex);
+		globalMin = std::min(globalMin, localMin);
+		globalMax = std::max(globalMax, localMax);
+	});
+
+	if(globalMin > globalMax)
+		globalMin = globalMax = 0.0f; // Nothing was hit
+	minDepth = globalMin;
+	maxDepth = globalMax;
+}
+
+// Spread consecutive ids over the hue circle with the golden ratio
+static void idColor(int id, unsigned char *rgb)
+{
+	if(id < 0)
+	{
+		rgb[0] = rgb[1] = rgb[2] = 0;
+		return;
+	}
+	float h = (id * 0.618034f) - (int)(id * 0.618034f);
+	float r = std::min(std::max(fabsf(h * 6.0f - 3.0f) - 1.0f, 0.0f), 1.0f);
+	float g = std::min(std::max(2.0f - fabsf(h * 6.0f - 2.0f), 0.0f), 1.0f);
+	float b = std::min(std::max(2.0f - fabsf(h * 6.0f - 4.0f), 0.0f), 1.0f);
+	rgb[0] = (unsigned char)(255.0f * r);
+	rgb[1] = (unsigned char)(255.0f * g);
+	rgb[2] = (unsigned char)(255.0f * b);
+}
+
+static inline unsigned char toByte(float v)
+{
+	return (unsigned char)(255.0f * std::min(std::max(v, 0.0f), 1.0f));
+}
+
+void AOVBuffer::toBitmap(Channel channel, unsigned char *rgb) const
+{
+	std::size_t n = std::size_t(width) * height;
+	float range = maxDepth > minDepth ? maxDepth - minDepth : 1.0f;
+	for(std::size_t k = 0; k < n; k++)
+	{
+		unsigned char *p = rgb + k*3;
+		switch(channel)
+		{
+			case DEPTH:
+				p[0] = p[1] = p[2] = objectId[k] < 0 ? 0 : toByte(1.0f - (depth[k] - minDepth) / range);
+				break;
+			case NORMAL:
+				for(int c = 0; c < 3; c++)
+					p[c] = objectId[k] < 0 ? 0 : toByte(0.5f * normal[k*3 + c] + 0.5f);
+				break;
+			case ALBEDO:
+				for(int c = 0; c < 3; c++)
+					p[c] = toByte(albedo[k*3 + c]);
+				break;
+			case OBJECT_ID:
+				idColor(objectId[k], p);
+				break;
+			case MATERIAL_ID:
+				idColor(materialId[k], p);
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+const char* AOVBuffer::getChannelName(Channel channel)
+{
+	static const char* names[NUM_CHANNELS] = {"depth", "normal", "albedo", "objectid", "materialid"};
+	return names[channel];
+}
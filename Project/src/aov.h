@@ -0,0 +1,40 @@
+//aov.h
+#ifndef _AOV_H_
+#define _AOV_H_
+
+#include "world.h"
+#include "camera.h"
+
+// Arbitrary output variables written from primary hits only, in a single pass with no
+// shading and no secondary rays. Pixels whose ray misses everything get id -1 and no depth.
+class AOVBuffer
+{
+public:
+	enum Channel { DEPTH, NORMAL, ALBEDO, OBJECT_ID, MATERIAL_ID, NUM_CHANNELS };
+
+private:
+	int width, height;
+	float *depth;    // Linear depth along the camera's viewing axis
+	float *normal;   // Interleaved xyz
+	float *albedo;   // Interleaved rgb
+	int *objectId;
+	int *materialId;
+	float minDepth, maxDepth; // Depth range over all hits, found by render()
+
+public:
+	AOVBuffer(int w, int h);
+	~AOVBuffer();
+
+	// Trace one primary ray through the centre of every pixel on numThreads threads (0 = all)
+	void render(World *world, Camera *camera, int numThreads);
+
+	float getMinDepth() const {return minDepth;}
+	float getMaxDepth() const {return maxDepth;}
+
+	// Visualise a channel as 8-bit RGB: depth is normalised to the measured range (near is white),
+	// normals are mapped from [-1, 1] and ids get a distinct colour each
+	void toBitmap(Channel channel, unsigned char *rgb) const;
+
+	static const char* getChannelName(Channel channel);
+};
+#endif
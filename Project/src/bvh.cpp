@@ -0,0 +1,317 @@
+//bvh.cpp
+
+#include "bvh.h"
+#include <algorithm>
+#include <float.h>
+#include <exception>
+#include <functional>
+#include <thread>
+#include "parallel.h"
+
+#define BVH_BINS 16
+
+struct BVHBounds
+{
+	float min[3], max[3];
+
+	void reset()
+	{
+		min[0] = min[1] = min[2] = FLT_MAX;
+		max[0] = max[1] = max[2] = -FLT_MAX;
+	}
+	void grow(const BVHBounds& b)
+	{
+		for(int a = 0; a < 3; a++)
+		{
+			min[a] = std::min(min[a], b.min[a]);
+			max[a] = std::max(max[a], b.max[a]);
+		}
+	}
+	void growPoint(const float *p)
+	{
+		for(int a = 0; a < 3; a++)
+		{
+			min[a] = std::min(min[a], p[a]);
+			max[a] = std::max(max[a], p[a]);
+		}
+	}
+	float area() const
+	{
+		float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+		return dx < 0 ? 0.0f : 2.0f * (dx*dy + dy*dz + dz*dx);
+	}
+};
+
+// Primitive reference moved around during the build, so every pass over a node's range
+// reads contiguous memory instead of gathering boxes through an index array
+struct BVHPrimitive
+{
+	float min[3], max[3];
+	unsigned index;
+
+	float centroid(int axis) const {return 0.5f * (min[axis] + max[axis]);}
+};
+
+// Primitives copied with their boxes
+struct BVHCopiedBounds
+{
+	void operator()(const BVHPrimitive& p, BVHPrimitive& box) const {box = p;}
+};
+
+// Primitives given by index only, their boxes computed again whenever a pass needs them
+struct BVHIndexBounds
+{
+	const std::function<void(unsigned, float*, float*)> *bounds;
+
+	void operator()(unsigned k, BVHPrimitive& box) const {(*bounds)(k, box.min, box.max);}
+};
+
+// Ranges smaller than this are not worth a thread of their own
+#define BVH_PARALLEL_MIN_PRIMITIVES 65536
+
+// Sets the node's bounds and either makes it a leaf (returns false) or partitions
+// prims[begin, end) with a binned surface area heuristic and returns the split in mid.
+// boxOf(prim, box) gives a primitive's box.
+template<typename Prim, typename BoxOf>
+static bool splitNode(std::vector<Prim>& prims, const BoxOf& boxOf, std::size_t begin, std::size_t end, int depth,
+                      BVHNode& node, std::size_t& mid)
+{
+	BVHBounds bounds, centroidBounds;
+	bounds.reset();
+	centroidBounds.reset();
+	for(std::size_t k = begin; k < end; k++)
+	{
+		BVHPrimitive p;
+		boxOf(prims[k], p);
+		float c[3] = {p.centroid(0), p.centroid(1), p.centroid(2)};
+		for(int a = 0; a < 3; a++)
+		{
+			bounds.min[a] = std::min(bounds.min[a], p.min[a]);
+			bounds.max[a] = std::max(bounds.max[a], p.max[a]);
+		}
+		centroidBounds.growPoint(c);
+	}
+	for(int a = 0; a < 3; a++)
+	{
+		node.min[a] = bounds.min[a];
+		node.max[a] = bounds.max[a];
+	}
+
+	std::size_t count = end - begin;
+	int axis = 0;
+	for(int a = 1; a < 3; a++)
+		if(centroidBounds.max[a] - centroidBounds.min[a] > centroidBounds.max[axis] - centroidBounds.min[axis])
+			axis = a;
+	float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+
+	if(count <= BVH_MAX_LEAF_SIZE || depth >= BVH_MAX_DEPTH - 1 || extent <= 0.0f)
+	{
+		// A leaf; coincident centroids that cannot be split end up here too
+		node.first = (int)begin;
+		node.count = (int)count;
+		return false;
+	}
+	node.count = 0;
+
+	BVHBounds binBounds[BVH_BINS];
+	std::size_t binCount[BVH_BINS] = {0};
+	for(int b = 0; b < BVH_BINS; b++)
+		binBounds[b].reset();
+	const float minAxis = centroidBounds.min[axis];
+	const float scale = BVH_BINS / extent;
+	for(std::size_t k = begin; k < end; k++)
+	{
+		BVHPrimitive p;
+		boxOf(prims[k], p);
+		int b = std::min(BVH_BINS - 1, (int)((p.centroid(axis) - minAxis) * scale));
+		binCount[b]++;
+		for(int a = 0; a < 3; a++)
+		{
+			binBounds[b].min[a] = std::min(binBounds[b].min[a], p.min[a]);
+			binBounds[b].max[a] = std::max(binBounds[b].max[a], p.max[a]);
+		}
+	}
+
+	float rightArea[BVH_BINS];
+	std::size_t rightCount[BVH_BINS];
+	BVHBounds acc;
+	acc.reset();
+	std::size_t accCount = 0;
+	for(int b = BVH_BINS - 1; b > 0; b--)
+	{
+		acc.grow(binBounds[b]);
+		accCount += binCount[b];
+		rightArea[b] = acc.area();
+		rightCount[b] = accCount;
+	}
+
+	int bestSplit = -1;
+	float bestCost = FLT_MAX;
+	acc.reset();
+	accCount = 0;
+	for(int b = 1; b < BVH_BINS; b++)
+	{
+		acc.grow(binBounds[b - 1]);
+		accCount += binCount[b - 1];
+		if(accCount == 0 || rightCount[b] == 0)
+			continue;
+		float cost = acc.area() * accCount + rightArea[b] * rightCount[b];
+		if(cost < bestCost)
+		{
+			bestCost = cost;
+			bestSplit = b;
+		}
+	}
+
+	if(bestSplit < 0)
+		mid = begin + count / 2;
+	else
+		mid = std::partition(prims.begin() + begin, prims.begin() + end, [&](const Prim& prim) {
+			BVHPrimitive p;
+			boxOf(prim, p);
+			return std::min(BVH_BINS - 1, (int)((p.centroid(axis) - minAxis) * scale)) < bestSplit;
+		}) - prims.begin();
+	return true;
+}
+
+struct BVHBuildTask
+{
+	int node; // Negative for a right child not allocated yet: -(parent + 1)
+	std::size_t begin, end;
+	int depth;
+};
+
+// Builds the subtree over prims[begin, end) into nodes, with its root at index 0
+template<typename Prim, typename BoxOf>
+static void buildSubtree(std::vector<Prim>& prims, const BoxOf& boxOf, std::size_t begin, std::size_t end, int depth,
+                         std::vector<BVHNode>& nodes)
+{
+	nodes.push_back(BVHNode());
+	std::vector<BVHBuildTask> stack;
+	BVHBuildTask root = {0, begin, end, depth};
+	stack.push_back(root);
+	while(!stack.empty())
+	{
+		BVHBuildTask task = stack.back();
+		stack.pop_back();
+
+		// The left child is allocated right after its parent. The right child is allocated when
+		// its task is popped, after the whole left subtree, and its index patched into the parent.
+		if(task.node < 0)
+		{
+			int parent = -task.node - 1;
+			task.node = (int)nodes.size();
+			nodes[parent].first = task.node;
+			nodes.push_back(BVHNode());
+		}
+
+		std::size_t mid;
+		if(!splitNode(prims, boxOf, task.begin, task.end, task.depth, nodes[task.node], mid))
+			continue;
+		BVHBuildTask left = {(int)nodes.size(), task.begin, mid, task.depth + 1};
+		BVHBuildTask right = {-(task.node + 1), mid, task.end, task.depth + 1};
+		nodes.push_back(BVHNode());
+		stack.push_back(right);
+		stack.push_back(left);
+	}
+}
+
+// Top levels: the two halves of a split are built on separate threads and then
+// concatenated behind their parent, shifting the child links of the copied nodes
+template<typename Prim, typename BoxOf>
+static void buildParallel(std::vector<Prim>& prims, const BoxOf& boxOf, std::size_t begin, std::size_t end, int depth,
+                          int numThreads, std::vector<BVHNode>& nodes)
+{
+	if(numThreads <= 1 || end - begin < BVH_PARALLEL_MIN_PRIMITIVES)
+	{
+		buildSubtree(prims, boxOf, begin, end, depth, nodes);
+		return;
+	}
+
+	BVHNode root;
+	std::size_t mid;
+	if(!splitNode(prims, boxOf, begin, end, depth, root, mid))
+	{
+		nodes.push_back(root);
+		return;
+	}
+
+	std::vector<BVHNode> left, right;
+	std::exception_ptr leftError;
+	std::thread leftThread([&]() {
+		try
+		{
+			buildParallel(prims, boxOf, begin, mid, depth + 1, numThreads / 2, left);
+		}
+		catch(...)
+		{
+			leftError = std::current_exception();
+		}
+	});
+	try
+	{
+		buildParallel(prims, boxOf, mid, end, depth + 1, numThreads - numThreads / 2, right);
+	}
+	catch(...)
+	{
+		leftThread.join();
+		throw;
+	}
+	leftThread.join();
+	if(leftError)
+		std::rethrow_exception(leftError);
+
+	root.first = (int)(1 + left.size());
+	nodes.reserve(1 + left.size() + right.size());
+	nodes.push_back(root);
+	for(std::size_t k = 0; k < left.size(); k++)
+	{
+		nodes.push_back(left[k]);
+		if(left[k].count == 0)
+			nodes.back().first += 1;
+	}
+	left = std::vector<BVHNode>();
+	for(std::size_t k = 0; k < right.size(); k++)
+	{
+		nodes.push_back(right[k]);
+		if(right[k].count == 0)
+			nodes.back().first += root.first;
+	}
+}
+
+void buildBVH(const float *boxes, std::size_t n, std::vector<BVHNode>& nodes, std::vector<unsigned>& order)
+{
+	nodes.clear();
+	order.resize(n);
+	if(n == 0)
+		return;
+
+	std::vector<BVHPrimitive> prims(n);
+	for(std::size_t k = 0; k < n; k++)
+	{
+		for(int a = 0; a < 3; a++)
+		{
+			prims[k].min[a] = boxes[k*6 + a];
+			prims[k].max[a] = boxes[k*6 + a + 3];
+		}
+		prims[k].index = (unsigned)k;
+	}
+
+	buildParallel(prims, BVHCopiedBounds(), 0, n, 1, defaultThreadCount(), nodes);
+
+	for(std::size_t k = 0; k < n; k++)
+		order[k] = prims[k].index;
+}
+
+void buildBVH(std::size_t n, const std::function<void(unsigned, float*, float*)>& bounds, std::vector<BVHNode>& nodes,
+              std::vector<unsigned>& order)
+{
+	nodes.clear();
+	order.resize(n);
+	if(n == 0)
+		return;
+	for(std::size_t k = 0; k < n; k++)
+		order[k] = (unsigned)k;
+	BVHIndexBounds boxOf = {&bounds};
+	buildParallel(order, boxOf, 0, n, 1, defaultThreadCount(), nodes);
+}
@@ -0,0 +1,85 @@
+//bvh.h
+#ifndef _BVH_H_
+#define _BVH_H_
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+#include "ray.h"
+
+// Flat bounding volume hierarchy node, 32 bytes. Nodes are stored depth first: an interior
+// node's left child follows it directly and 'first' is the index of its right child. A leaf
+// (count > 0) covers primitives [first, first + count) of the BVH's primitive order.
+struct BVHNode
+{
+	float min[3];
+	int first;
+	float max[3];
+	int count;
+};
+
+#define BVH_MAX_LEAF_SIZE 4
+#define BVH_MAX_DEPTH 64
+
+// Builds a binned SAH hierarchy over n primitives given as boxes (minx, miny, minz, maxx, maxy, maxz).
+// order receives the primitive index of every leaf slot; callers either store their primitives
+// in that order or keep order as an indirection.
+void buildBVH(const float *boxes, std::size_t n, std::vector<BVHNode>& nodes, std::vector<unsigned>& order);
+// Builds the same hierarchy with order as its only array of one entry per primitive, for
+// primitives too many to copy: bounds(k, min, max) gives primitive k's box whenever the build
+// needs it, a few times per level, and may be called from several threads at once.
+void buildBVH(std::size_t n, const std::function<void(unsigned, float*, float*)>& bounds, std::vector<BVHNode>& nodes,
+              std::vector<unsigned>& order);
+
+// Slab test against the ray's current closest hit
+inline bool intersectBox(const BVHNode& node, const float origin[3], const float invDir[3], float tMax)
+{
+	float t0 = 0.0f, t1 = tMax;
+	for(int a = 0; a < 3; a++)
+	{
+		float tNear = (node.min[a] - origin[a]) * invDir[a];
+		float tFar = (node.max[a] - origin[a]) * invDir[a];
+		if(tNear > tFar)
+		{
+			float tmp = tNear;
+			tNear = tFar;
+			tFar = tmp;
+		}
+		t0 = tNear > t0 ? tNear : t0;
+		t1 = tFar < t1 ? tFar : t1;
+	}
+	return t0 <= t1;
+}
+
+// Calls leaf(first, count) for every leaf whose box the ray reaches before its current hit.
+// The leaf callback may shorten the ray, which prunes the rest of the traversal.
+template<typename Leaf>
+inline void traverseBVH(const BVHNode *nodes, const Ray& ray, Leaf leaf)
+{
+	Vector3D o = ray.getOrigin(), d = ray.getDirection();
+	const float origin[3] = {(float)o.X(), (float)o.Y(), (float)o.Z()};
+	const float invDir[3] = {1.0f / (float)d.X(), 1.0f / (float)d.Y(), 1.0f / (float)d.Z()};
+
+	int stack[BVH_MAX_DEPTH];
+	int top = 0;
+	int node = 0;
+	for(;;)
+	{
+		const BVHNode& n = nodes[node];
+		if(intersectBox(n, origin, invDir, ray.getParameter()))
+		{
+			if(n.count == 0)
+			{
+				stack[top++] = n.first;
+				node++;
+				continue;
+			}
+			leaf(n.first, n.count);
+		}
+		if(top == 0)
+			return;
+		node = stack[--top];
+	}
+}
+
+#endif
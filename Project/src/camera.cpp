@@ -1,13 +1,15 @@
 #include "camera.h"
 #define _USE_MATH_DEFINES
 #include <cmath>
+#include <algorithm>
 
 #include <iostream>
 #include <ostream>
 using namespace std;
 
 Camera::Camera(const Vector3D& _pos, const Vector3D& _target, const Vector3D& _up, float _fovy, int _width, int _height, int _n) :
-position(_pos), target(_target), up(_up), fovy(_fovy), width(_width), height(_height), samplesPerPixel(_n)
+position(_pos), target(_target), up(_up), denoiser(NULL), width(_width), height(_height), imageHeight(_height), firstRow(0),
+fovy(_fovy), samplesPerPixel(_n)
 {
 	up.normalize();
 
@@ -21,6 +23,7 @@ position(_pos), target(_target), up(_up), fovy(_fovy), width(_width), height(_he
 	u.normalize();
 	v = crossProduct(w, u);
 	v.normalize();
+	framebuffer = new FrameBuffer(width, height);
 	bitmap  = new unsigned char[width * height * 3]; //RGB
 	for (std::size_t i = 0; i < 3*width*height; ++i) {
 		bitmap[i] = 0;
@@ -33,73 +36,89 @@ position(_pos), target(_target), up(_up), fovy(_fovy), width(_width), height(_he
 
 Camera::~Camera()
 {
+	delete framebuffer;
 	delete []bitmap;
 }
 
+void Camera::setBand(int imageRows, int first, int rows)
+{
+	if(rows != height)
+	{
+		delete framebuffer;
+		delete []bitmap;
+		height = rows;
+		framebuffer = new FrameBuffer(width, height);
+		bitmap = new unsigned char[std::size_t(width) * height * 3];
+	}
+	else
+		framebuffer->clear();
+	std::fill(bitmap, bitmap + std::size_t(width) * height * 3, 0);
+	imageHeight = imageRows;
+	firstRow = first;
+	aspect = float(width)/float(imageHeight);
+	focalWidth = focalHeight * aspect;
+}
+
 //Get direction of viewing ray from pixel coordinates (i, j)
 const Vector3D Camera::get_ray_direction(const int i, const int j, int sampleIndex) const
 {
     Vector3D dir(0.0, 0.0, 0.0);
 
-    if(IsRenderingObject)
+    for (int p = 0; p < samplesPerPixel; p++)
     {
-        for (int p = 0; p < samplesPerPixel; p++)
-        {
-            // Generate random offsets in [0, 1)
-            float offsetX = static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
-            float offsetY = static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
-
-            for (int q = 0; q < samplesPerPixel; q++)
-            {
-                dir += -w * focalDistance;
+        // Generate random offsets in [0, 1)
+        float offsetX = static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
+        float offsetY = static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
 
-                // Compute the direction with jittered sampling
-                float xw = aspect * (i - width / 2.0 + (p + offsetX) + 0.5) / width;
-                float yw = (j - height / 2.0 + (q + offsetY) + 0.5) / height;
-
-                dir += u * xw + v * yw;
-            }
-        }
-    }
-
-    else
-    {
-        /*
-        dir += -w * focalDistance;
-        float xw = aspect*(i - width/2.0 + 0.5)/width;
-        float yw = (j - height/2.0 + 0.5)/height;
-        dir += u * xw;
-        dir += v * yw;
-        */
-
-        for (int p = 0; p < samplesPerPixel; p++)
+        for (int q = 0; q < samplesPerPixel; q++)
         {
-            // Generate random offsets in [0, 1)
-            float offsetX = static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
-            float offsetY = static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
-
-            for (int q = 0; q < samplesPerPixel; q++)
-            {
-                dir += -w * focalDistance;
+            dir += -w * focalDistance;
 
-                // Compute the direction with jittered sampling
-                float xw = aspect * (i - width / 2.0 + (p + offsetX) + 0.5) / width;
-                float yw = (j - height / 2.0 + (q + offsetY) + 0.5) / height;
+            // Compute the direction with jittered sampling
+            float xw = aspect * (i - width / 2.0 + (p + offsetX) + 0.5) / width;
+            float yw = (firstRow + j - imageHeight / 2.0 + (q + offsetY) + 0.5) / imageHeight;
 
-                dir += u * xw + v * yw;
-            }
+            dir += u * xw + v * yw;
         }
     }
 
+    dir.normalize();
+    return dir;
+}
 
+//Get direction of a single viewing ray through the point (offsetX, offsetY) in [0, 1)^2 of pixel (i, j)
+const Vector3D Camera::get_sample_direction(const int i, const int j, float offsetX, float offsetY) const
+{
+    Vector3D dir = -w * focalDistance;
+    float xw = aspect * (i - width / 2.0 + offsetX) / width;
+    float yw = (firstRow + j - imageHeight / 2.0 + offsetY) / imageHeight;
+    dir += u * xw + v * yw;
     dir.normalize();
     return dir;
 }
 
-void Camera::drawPixel(int i, int j, Color c)
+void Camera::resolve(bool postProcess)
+{
+    resolveTo(bitmap, 3, postProcess);
+}
+
+void Camera::resolveTo(unsigned char *pixels, int channels, bool postProcess)
 {
-	int index = (i + j*width)*3;
-	bitmap[index + 0] = 255 * c.r ;
-	bitmap[index + 1] = 255 * c.g;
-	bitmap[index + 2] = 255 * c.b;
+    if(!postProcess || !denoiser)
+    {
+        framebuffer->resolve(pixels, channels);
+        return;
+    }
+
+    std::size_t n = std::size_t(width) * height;
+    float *denoised = new float[n * 3];
+    denoiser->apply(*framebuffer, denoised);
+    for(std::size_t k = 0; k < n; k++)
+    {
+        for(int c = 0; c < 3; c++)
+            pixels[k*channels + c] = (unsigned char)(255.0f * std::min(std::max(denoised[k*3 + c], 0.0f), 1.0f));
+        if(channels == 4)
+            pixels[k*channels + 3] = 255;
+    }
+    delete []denoised;
 }
@@ -4,6 +4,8 @@
 #include "vector3D.h"
 #include "color.h"
 #include "ray.h"
+#include "framebuffer.h"
+#include "denoiser.h"
 
 class Camera
 {
@@ -15,27 +17,44 @@ private:
 	Vector3D line_of_sight;
 	Vector3D u, v, w; //Camera basis vectors
 
-	unsigned char *bitmap;
-	int width, height;
+	FrameBuffer *framebuffer; //HDR accumulation buffer written by the renderer
+	unsigned char *bitmap; //8-bit display image, refreshed by resolve()
+	const Denoiser *denoiser; //Optional post-process stage run by resolve(true)
+	int width, height; // Size of the buffers
+	int imageHeight, firstRow; // The buffers hold rows [firstRow, firstRow + height) of an image this tall
 	float fovy;// expressed in degrees: FOV-Y; angular extent of the height of the image plane
 	float focalDistance; //Distance from camera center to the image plane
 	float focalWidth, focalHeight;//width and height of focal plane
 	float aspect;
 
-    bool IsRenderingObject; // To check if object is being rendered
-
 	int samplesPerPixel; // Number of samples per pixel (n)
 
 public:
 	Camera(const Vector3D& _pos, const Vector3D& _target, const Vector3D& _up, float fovy, int w, int h, int n);
 	~Camera();
 	const Vector3D get_ray_direction(const int i, const int j, int sampleIndex) const;
+	const Vector3D get_sample_direction(const int i, const int j, float offsetX, float offsetY) const;
 	const Vector3D& get_position() const { return position; }
-	void drawPixel(int i, int j, Color c);
+	const Vector3D get_forward() const { return -w; }
+	void addSample(int i, int j, const Color& c) {framebuffer->addSample(i, j, c);}
+	// Refresh the display bitmap from the accumulation buffer. With postProcess set, the
+	// denoiser (if any) runs between the accumulated image and the 8-bit conversion.
+	void resolve(bool postProcess = false);
+	// The same into a caller's buffer, 3 (RGB) or 4 (RGBA, opaque) bytes per pixel
+	void resolveTo(unsigned char *pixels, int channels, bool postProcess = false);
+	void setDenoiser(const Denoiser *d) {denoiser = d;}
+	FrameBuffer * getFrameBuffer() {return framebuffer; }
 	unsigned char * getBitmap() {return bitmap; }
 	int getWidth() {return width;}
 	int getHeight(){return height;}
-    void setIsRenderingObject(bool value){IsRenderingObject = value;}
+
+	// Render rows [first, first + rows) of an image imageRows tall into buffers of just those rows.
+	// Pixel row j of the camera and its buffers is then row first + j of the image, and rays follow
+	// the whole image's geometry, so an image of any height can be rendered band by band. The
+	// buffers are cleared, and reallocated if rows changes.
+	void setBand(int imageRows, int first, int rows);
+	int getImageHeight() const {return imageHeight;}
+	int getFirstRow() const {return firstRow;}
 
 };
 #endif
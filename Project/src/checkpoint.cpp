@@ -0,0 +1,131 @@
+//checkpoint.cpp
+
+#include "checkpoint.h"
+#include "filepath.h"
+#include "scenebinary.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CHECKPOINT_BYTE_ORDER 0x01020304u
+
+uint64_t hashBytes(const void *data, std::size_t size, uint64_t hash)
+{
+	const unsigned char *bytes = static_cast<const unsigned char*>(data);
+	for(std::size_t k = 0; k < size; k++)
+	{
+		hash ^= bytes[k];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+bool hashSceneFile(const char *path, uint64_t& hash, std::string& error)
+{
+	uint64_t contentHash;
+	if(readBinarySceneHash(path, contentHash))
+	{
+		hash = hashBytes(&contentHash, sizeof(contentHash), hash);
+		return true;
+	}
+	struct stat status;
+	if(stat(path, &status) != 0)
+	{
+		error = std::string("cannot open ") + path + ": " + std::strerror(errno);
+		return false;
+	}
+	int64_t identity[3] = {(int64_t)status.st_size, (int64_t)status.st_mtim.tv_sec, (int64_t)status.st_mtim.tv_nsec};
+	hash = hashBytes(identity, sizeof(identity), hash);
+	return true;
+}
+
+bool writeCheckpoint(const char *path, uint64_t sceneHash, const FrameBuffer& framebuffer, const RenderEngine& engine,
+                     std::string& error)
+{
+	CheckpointHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+	header.version = CHECKPOINT_VERSION;
+	header.byteOrder = CHECKPOINT_BYTE_ORDER;
+	header.sceneHash = sceneHash;
+	header.width = framebuffer.getWidth();
+	header.height = framebuffer.getHeight();
+	header.passes = engine.getPass();
+	header.lastActivePixels = engine.getActivePixels();
+	header.samplesTaken = engine.getSamplesTaken();
+	std::strncpy(header.sampler, engine.getSampler()->getName(), sizeof(header.sampler) - 1);
+
+	std::string temporary = std::string(path) + ".tmp";
+	FILE *file = std::fopen(temporary.c_str(), "wb");
+	if(!file)
+	{
+		error = "cannot create " + temporary + ": " + std::strerror(errno);
+		return false;
+	}
+	// The data must be on disk before the rename makes it the checkpoint. errno is taken right
+	// after the call that failed, before fclose or remove can change it.
+	int failure = 0;
+	errno = 0;
+	if(std::fwrite(&header, sizeof(header), 1, file) != 1 || !framebuffer.write(file) || std::fflush(file) != 0 ||
+	   fsync(fileno(file)) != 0)
+		failure = errno ? errno : EIO;
+	if(std::fclose(file) != 0 && !failure)
+		failure = errno;
+	if(!failure && std::rename(temporary.c_str(), path) != 0)
+		failure = errno;
+	if(failure)
+	{
+		error = std::string("error writing checkpoint ") + path + ": " + std::strerror(failure);
+		std::remove(temporary.c_str());
+		return false;
+	}
+
+	// The rename itself only survives a crash once the directory holding it is on disk. EINVAL
+	// means the file system has no way to sync a directory.
+	std::string directory = directoryOf(path);
+	int dir = open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY);
+	if(dir < 0 || (fsync(dir) != 0 && errno != EINVAL))
+		failure = errno;
+	if(dir >= 0)
+		close(dir);
+	if(failure)
+	{
+		error = std::string("cannot sync the directory of checkpoint ") + path + ": " + std::strerror(failure);
+		return false;
+	}
+	return true;
+}
+
+bool readCheckpoint(const char *path, uint64_t sceneHash, FrameBuffer& framebuffer, RenderEngine& engine, std::string& error)
+{
+	error.clear();
+	FILE *file = std::fopen(path, "rb");
+	if(!file)
+	{
+		if(errno != ENOENT)
+			error = std::string("cannot open checkpoint ") + path + ": " + std::strerror(errno);
+		return false;
+	}
+
+	CheckpointHeader header;
+	bool ok = std::fread(&header, sizeof(header), 1, file) == 1;
+	if(!ok || std::memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0 || header.version != CHECKPOINT_VERSION ||
+	   header.byteOrder != CHECKPOINT_BYTE_ORDER)
+		error = std::string(path) + " is not a checkpoint of this version";
+	else if(header.sceneHash != sceneHash || header.width != framebuffer.getWidth() || header.height != framebuffer.getHeight())
+		error = std::string(path) + " is a checkpoint of another scene, image size or adaptive threshold";
+	else if(std::strncmp(header.sampler, engine.getSampler()->getName(), sizeof(header.sampler)) != 0)
+		error = std::string(path) + " was rendered with the " + std::string(header.sampler, strnlen(header.sampler, sizeof(header.sampler))) +
+		        " sampler";
+	else if(!framebuffer.read(file))
+		error = std::string(path) + " is truncated";
+	std::fclose(file);
+	if(!error.empty())
+		return false;
+
+	engine.resume(header.passes, header.samplesTaken, header.lastActivePixels);
+	return true;
+}
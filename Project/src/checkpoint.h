@@ -0,0 +1,45 @@
+//checkpoint.h
+#ifndef _CHECKPOINT_H_
+#define _CHECKPOINT_H_
+
+#include <stdint.h>
+#include <string>
+#include "framebuffer.h"
+#include "renderengine.h"
+
+#define CHECKPOINT_MAGIC "LUMCKPT1"
+#define CHECKPOINT_VERSION 1
+
+// Everything a render needs to carry on where it stopped: the frame buffer's sums and sample
+// counts, the passes and samples completed, and the sampler, whose sequence for each pixel is
+// indexed by that pixel's sample count. sceneHash identifies the scene and settings the
+// samples were taken with; a checkpoint is only resumed by a render with the same hash.
+struct CheckpointHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint64_t sceneHash;
+	int32_t width, height;
+	int32_t passes;
+	int32_t lastActivePixels;
+	int64_t samplesTaken;
+	char sampler[16];
+};
+
+// 64-bit FNV-1a, continuing from hash
+uint64_t hashBytes(const void *data, std::size_t size, uint64_t hash = 14695981039346656037ull);
+// Identifies a scene file without reading it through: a compiled scene by the content hash in
+// its header, any other file by its size and modification time. Continues from hash; returns
+// false and sets error if the file cannot be found.
+bool hashSceneFile(const char *path, uint64_t& hash, std::string& error);
+
+// Written to path.tmp and renamed over path once complete, so path always holds a whole
+// checkpoint, the previous one if writing fails part way
+bool writeCheckpoint(const char *path, uint64_t sceneHash, const FrameBuffer& framebuffer, const RenderEngine& engine,
+                     std::string& error);
+// Restores framebuffer and engine. Returns false with an empty error if there is no
+// checkpoint at path, and false with an error if it belongs to another render.
+bool readCheckpoint(const char *path, uint64_t sceneHash, FrameBuffer& framebuffer, RenderEngine& engine, std::string& error);
+
+#endif
@@ -0,0 +1,197 @@
+//compressedmesh.cpp
+
+#include "compressedmesh.h"
+#include <algorithm>
+#include <cmath>
+#include <float.h>
+
+// Grid offsets are kept below this so rounding never overflows 16 bits
+#define COMPRESSED_GRID_STEPS 65533.0f
+// Grid coordinates stay below 2^24, where every integer is exact as a float
+#define COMPRESSED_GRID_MAX 16777216.0f
+
+CompressedMesh::CompressedMesh(std::size_t nv, const float *v, std::size_t nt, const int *idx, const BVHNode *bvh, std::size_t numNodes,
+                               Material* mat, Camera* cam):
+	Object(mat, cam, COMPRESSED_MESH), numTriangles(nt), nodes(bvh, bvh + numNodes), maxError(0.0f)
+{
+	isSolid = true;
+	const std::size_t numClusters = (nt + COMPRESSED_CLUSTER_SIZE - 1) / COMPRESSED_CLUSTER_SIZE;
+
+	// The grid step is set by the largest cluster, so that every cluster fits in 16 bits
+	float lo[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, hi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+	float clusterExtent[3] = {0.0f, 0.0f, 0.0f};
+	for(std::size_t c = 0; c < numClusters; c++)
+	{
+		float cmin[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, cmax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+		std::size_t end = std::min(nt, (c + 1) * COMPRESSED_CLUSTER_SIZE);
+		for(std::size_t k = c * COMPRESSED_CLUSTER_SIZE * 3; k < end * 3; k++)
+			for(int a = 0; a < 3; a++)
+			{
+				float x = v[idx[k] * std::size_t(3) + a];
+				cmin[a] = std::min(cmin[a], x);
+				cmax[a] = std::max(cmax[a], x);
+			}
+		for(int a = 0; a < 3; a++)
+		{
+			clusterExtent[a] = std::max(clusterExtent[a], cmax[a] - cmin[a]);
+			lo[a] = std::min(lo[a], cmin[a]);
+			hi[a] = std::max(hi[a], cmax[a]);
+		}
+	}
+	for(int a = 0; a < 3; a++)
+	{
+		base[a] = numClusters > 0 ? lo[a] : 0.0f;
+		step[a] = numClusters > 0 ? std::max(clusterExtent[a] / COMPRESSED_GRID_STEPS, (hi[a] - lo[a]) / COMPRESSED_GRID_MAX) : 0.0f;
+		if(step[a] <= 0.0f)
+			step[a] = 1.0f; // Flat along this axis: every offset is 0
+	}
+
+	// Per cluster: its vertices in order of first use, as offsets from the cluster's origin
+	clusters.resize(numClusters);
+	indices.resize(nt * 3);
+	vertices.reserve(nt * 3);
+	std::vector<int> local(nv, -1);
+	std::vector<int> used;
+	std::vector<int32_t> grid;
+	for(std::size_t c = 0; c < numClusters; c++)
+	{
+		std::size_t begin = c * COMPRESSED_CLUSTER_SIZE * 3, end = std::min(nt, (c + 1) * COMPRESSED_CLUSTER_SIZE) * 3;
+		used.clear();
+		for(std::size_t k = begin; k < end; k++)
+		{
+			int& l = local[idx[k]];
+			if(l < 0)
+			{
+				l = (int)used.size();
+				used.push_back(idx[k]);
+			}
+			indices[k] = (uint8_t)l;
+		}
+
+		grid.resize(used.size() * 3);
+		CompressedCluster& cluster = clusters[c];
+		cluster.origin[0] = cluster.origin[1] = cluster.origin[2] = INT32_MAX;
+		for(std::size_t u = 0; u < used.size(); u++)
+			for(int a = 0; a < 3; a++)
+			{
+				grid[u*3 + a] = (int32_t)std::lrint((v[used[u] * std::size_t(3) + a] - base[a]) / step[a]);
+				cluster.origin[a] = std::min(cluster.origin[a], grid[u*3 + a]);
+			}
+		cluster.firstVertex = (uint32_t)(vertices.size() / 3);
+		for(std::size_t u = 0; u < used.size(); u++)
+		{
+			for(int a = 0; a < 3; a++)
+			{
+				int32_t offset = std::min(grid[u*3 + a] - cluster.origin[a], 65535);
+				vertices.push_back((uint16_t)offset);
+				float decoded = base[a] + step[a] * (float)(cluster.origin[a] + offset);
+				maxError = std::max(maxError, std::fabs(decoded - v[used[u] * std::size_t(3) + a]));
+			}
+			local[used[u]] = -1;
+		}
+	}
+	std::vector<uint16_t>(vertices).swap(vertices);
+
+	// Refit the hierarchy to the decoded triangles. Children always follow their parent,
+	// so a reverse sweep sees both children of a node before the node itself.
+	for(std::size_t n = nodes.size(); n-- > 0; )
+	{
+		BVHNode& node = nodes[n];
+		float nmin[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, nmax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+		if(node.count > 0)
+		{
+			for(int t = node.first; t < node.first + node.count; t++)
+			{
+				float tri[3][3];
+				decode(t, tri);
+				for(int k = 0; k < 3; k++)
+					for(int a = 0; a < 3; a++)
+					{
+						nmin[a] = std::min(nmin[a], tri[k][a]);
+						nmax[a] = std::max(nmax[a], tri[k][a]);
+					}
+			}
+		}
+		else
+		{
+			const BVHNode& left = nodes[n + 1];
+			const BVHNode& right = nodes[node.first];
+			for(int a = 0; a < 3; a++)
+			{
+				nmin[a] = std::min(left.min[a], right.min[a]);
+				nmax[a] = std::max(left.max[a], right.max[a]);
+			}
+		}
+		for(int a = 0; a < 3; a++)
+		{
+			node.min[a] = nmin[a];
+			node.max[a] = nmax[a];
+		}
+	}
+}
+
+inline void CompressedMesh::decode(std::size_t triangle, float v[3][3]) const
+{
+	const CompressedCluster& cluster = clusters[triangle / COMPRESSED_CLUSTER_SIZE];
+	const uint8_t *idx = &indices[triangle * 3];
+	for(int k = 0; k < 3; k++)
+	{
+		const uint16_t *q = &vertices[(cluster.firstVertex + idx[k]) * std::size_t(3)];
+		for(int a = 0; a < 3; a++)
+			v[k][a] = base[a] + step[a] * (float)(cluster.origin[a] + q[a]);
+	}
+}
+
+std::size_t CompressedMesh::getMemoryUsage() const
+{
+	return sizeof(*this) + clusters.size() * sizeof(CompressedCluster) + vertices.size() * sizeof(uint16_t) +
+	       indices.size() + nodes.size() * sizeof(BVHNode);
+}
+
+bool CompressedMesh::intersect(Ray& r) const
+{
+	const Vector3D o = r.getOrigin(), d = r.getDirection();
+	long hit = -1;
+	Vector3D hitEdge1, hitEdge2;
+
+	traverseBVH(nodes.data(), r, [&](int first, int n) {
+		for(int k = first; k < first + n; k++)
+		{
+			float v[3][3];
+			decode(k, v);
+			Vector3D vertex1(v[0][0], v[0][1], v[0][2]);
+			Vector3D edge1 = Vector3D(v[1][0], v[1][1], v[1][2]) - vertex1;
+			Vector3D edge2 = Vector3D(v[2][0], v[2][1], v[2][2]) - vertex1;
+
+			// Moller-Trumbore, as in TriangleMesh::intersect
+			Vector3D h = crossProduct(d, edge2);
+			float a = dotProduct(edge1, h);
+			if(a > -SMALLEST_DIST && a < SMALLEST_DIST)
+				continue;
+			float f = 1.0f / a;
+			Vector3D s = o - vertex1;
+			float beta = f * dotProduct(s, h);
+			if(beta <= 0.0f || beta >= 1.0f)
+				continue;
+			Vector3D q = crossProduct(s, edge1);
+			float gamma = f * dotProduct(d, q);
+			if(gamma <= 0.0f || beta + gamma >= 1.0f)
+				continue;
+
+			if(r.setParameter(f * dotProduct(edge2, q), this))
+			{
+				hit = k;
+				hitEdge1 = edge1;
+				hitEdge2 = edge2;
+			}
+		}
+	});
+
+	if(hit < 0)
+		return false;
+	r.setLevel(r.getLevel() + 1);
+	Vector3D normal = crossProduct(hitEdge2, hitEdge1);
+	normal.normalize();
+	r.setNormal(normal);
+	return true;
+}
@@ -0,0 +1,53 @@
+//compressedmesh.h
+#ifndef _COMPRESSEDMESH_H_
+#define _COMPRESSEDMESH_H_
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+#include "object.h"
+#include "bvh.h"
+
+// Triangles per cluster. Every cluster has at most 3 * 64 vertices, so a triangle's corners
+// fit in one byte each.
+#define COMPRESSED_CLUSTER_SIZE 64
+
+// Runs of COMPRESSED_CLUSTER_SIZE consecutive triangles in BVH leaf order, so a cluster is a
+// small subtree. A cluster keeps its own copy of the vertices it uses, in order of first use.
+struct CompressedCluster
+{
+	int32_t origin[3];    // Grid position of the cluster's bounds
+	uint32_t firstVertex; // Into CompressedMesh::vertices
+};
+
+// Indexed triangle mesh stored quantized: about 8.5 bytes of geometry per triangle against 18 for
+// TriangleMesh, plus the same BVH (about 17 bytes per triangle). A vertex is three 16-bit
+// offsets from its cluster's origin on a grid shared by the whole mesh, and a triangle is three
+// 8-bit indices into its cluster's vertices. Because the grid is shared, a vertex used by several
+// clusters decodes to exactly the same position in each, so the mesh stays watertight. Vertices
+// are decoded into registers as triangles are tested; the BVH is refitted to the decoded
+// triangles. Hits and normals otherwise match TriangleMesh.
+class CompressedMesh : public Object
+{
+private:
+	std::size_t numTriangles;
+	float base[3], step[3]; // Grid: position = base + step * (origin + offset)
+	std::vector<CompressedCluster> clusters;
+	std::vector<uint16_t> vertices;
+	std::vector<uint8_t> indices;
+	std::vector<BVHNode> nodes;
+	float maxError;
+
+	void decode(std::size_t triangle, float v[3][3]) const;
+
+public:
+	// Compresses a mesh whose triangles are in the leaf order of bvh (see compileScene)
+	CompressedMesh(std::size_t nv, const float *v, std::size_t nt, const int *idx, const BVHNode *bvh, std::size_t numNodes,
+	               Material* mat, Camera* cam);
+
+	std::size_t getNumTriangles() const {return numTriangles;}
+	std::size_t getMemoryUsage() const; // Bytes, including the BVH
+	float getMaxError() const {return maxError;} // Largest distance of a decoded vertex coordinate from the original
+	bool intersect(Ray& r) const;
+};
+#endif
@@ -0,0 +1,168 @@
+//denoiser.cpp
+
+#include "denoiser.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// Planar copy of the colour and features so the filter loops read contiguous rows
+struct DenoiseBuffers
+{
+	int width, height;
+	std::vector<float> color[2][3]; // Ping-pong colour planes
+	std::vector<float> normal[3];
+	std::vector<float> albedo[3];
+	std::vector<float> depth;
+};
+
+// exp(-x) for x >= 0 as (1 - x/8)^8. Unlike expf it has no branches or calls,
+// so the compiler can vectorize the filter loop around it.
+static inline float expNeg(float x)
+{
+	float t = std::max(0.0f, 1.0f - x * 0.125f);
+	t *= t;
+	t *= t;
+	return t * t;
+}
+
+// One A-trous level over rows [rowBegin, rowEnd): a 5x5 B3-spline kernel with holes of size step
+static void filterRows(DenoiseBuffers& b, int src, float invSigmaColor2, float invSigmaNormal2,
+                       float invSigmaAlbedo2, float invSigmaDepth, int step, int rowBegin, int rowEnd)
+{
+	static const float kernel[5] = {1.0f/16, 1.0f/4, 3.0f/8, 1.0f/4, 1.0f/16};
+	const int w = b.width, h = b.height;
+	const int dst = 1 - src;
+
+	std::vector<float> sumR(w), sumG(w), sumB(w), sumW(w);
+
+	for(int y = rowBegin; y < rowEnd; y++)
+	{
+		std::fill(sumR.begin(), sumR.end(), 0.0f);
+		std::fill(sumG.begin(), sumG.end(), 0.0f);
+		std::fill(sumB.begin(), sumB.end(), 0.0f);
+		std::fill(sumW.begin(), sumW.end(), 0.0f);
+
+		const std::size_t row = std::size_t(y) * w;
+		const float *cr = &b.color[src][0][row], *cg = &b.color[src][1][row], *cb = &b.color[src][2][row];
+		const float *nx = &b.normal[0][row], *ny = &b.normal[1][row], *nz = &b.normal[2][row];
+		const float *ar = &b.albedo[0][row], *ag = &b.albedo[1][row], *ab = &b.albedo[2][row];
+		const float *d = &b.depth[row];
+
+		for(int ky = -2; ky <= 2; ky++)
+		{
+			int yy = y + ky * step;
+			if(yy < 0 || yy >= h)
+				continue;
+			const std::size_t trow = std::size_t(yy) * w;
+
+			for(int kx = -2; kx <= 2; kx++)
+			{
+				const int dx = kx * step;
+				const float k = kernel[ky + 2] * kernel[kx + 2];
+
+				// Only the x range whose tap stays inside the image; taps outside simply get no weight
+				const int x0 = std::max(0, -dx);
+				const int x1 = std::min(w, w - dx);
+				if(x0 >= x1)
+					continue;
+
+				// Index of the tap for pixel x is t + x; t itself may be negative on the first row
+				const std::ptrdiff_t t = std::ptrdiff_t(trow) + dx;
+				const float *tcr = b.color[src][0].data(), *tcg = b.color[src][1].data(), *tcb = b.color[src][2].data();
+				const float *tnx = b.normal[0].data(), *tny = b.normal[1].data(), *tnz = b.normal[2].data();
+				const float *tar = b.albedo[0].data(), *tag = b.albedo[1].data(), *tab = b.albedo[2].data();
+				const float *td = b.depth.data();
+
+				for(int x = x0; x < x1; x++)
+				{
+					const std::ptrdiff_t q = t + x;
+					float dr = tcr[q] - cr[x], dg = tcg[q] - cg[x], db = tcb[q] - cb[x];
+					float dnx = tnx[q] - nx[x], dny = tny[q] - ny[x], dnz = tnz[q] - nz[x];
+					float dar = tar[q] - ar[x], dag = tag[q] - ag[x], dab = tab[q] - ab[x];
+					float dd = (td[q] - d[x]) / (std::max(d[x], 1e-3f)) * invSigmaDepth;
+
+					float e = (dr*dr + dg*dg + db*db) * invSigmaColor2
+					        + (dnx*dnx + dny*dny + dnz*dnz) * invSigmaNormal2
+					        + (dar*dar + dag*dag + dab*dab) * invSigmaAlbedo2
+					        + dd*dd;
+					float wgt = k * expNeg(e);
+
+					sumR[x] += wgt * tcr[q];
+					sumG[x] += wgt * tcg[q];
+					sumB[x] += wgt * tcb[q];
+					sumW[x] += wgt;
+				}
+			}
+		}
+
+		// The centre tap always has weight 1/16 * 3/8 * 3/8, so sumW is never zero
+		float *outR = &b.color[dst][0][row], *outG = &b.color[dst][1][row], *outB = &b.color[dst][2][row];
+		for(int x = 0; x < w; x++)
+		{
+			float inv = 1.0f / sumW[x];
+			outR[x] = sumR[x] * inv;
+			outG[x] = sumG[x] * inv;
+			outB[x] = sumB[x] * inv;
+		}
+	}
+}
+
+void Denoiser::apply(const FrameBuffer& framebuffer, float *out) const
+{
+	DenoiseBuffers b;
+	b.width = framebuffer.getWidth();
+	b.height = framebuffer.getHeight();
+	const std::size_t numPixels = std::size_t(b.width) * b.height;
+	for(int c = 0; c < 3; c++)
+	{
+		b.color[0][c].resize(numPixels);
+		b.color[1][c].resize(numPixels);
+		b.normal[c].resize(numPixels);
+		b.albedo[c].resize(numPixels);
+	}
+	b.depth.resize(numPixels);
+
+	parallelFor(0, b.height, numThreads, [&](int rowBegin, int rowEnd) {
+		float f[FEATURE_CHANNELS];
+		for(int y = rowBegin; y < rowEnd; y++)
+			for(int x = 0; x < b.width; x++)
+			{
+				std::size_t k = std::size_t(y) * b.width + x;
+				Color c = framebuffer.getMean(x, y);
+				framebuffer.getFeatures(x, y, f);
+				b.color[0][0][k] = c.r;
+				b.color[0][1][k] = c.g;
+				b.color[0][2][k] = c.b;
+				for(int ch = 0; ch < 3; ch++)
+				{
+					b.normal[ch][k] = f[ch];
+					b.albedo[ch][k] = f[3 + ch];
+				}
+				b.depth[k] = f[6];
+			}
+	});
+
+	int src = 0;
+	float sigmaC = sigmaColor;
+	for(int level = 0; level < iterations; level++)
+	{
+		float invSigmaColor2 = 1.0f / (sigmaC * sigmaC);
+		float invSigmaNormal2 = 1.0f / (sigmaNormal * sigmaNormal);
+		float invSigmaAlbedo2 = 1.0f / (sigmaAlbedo * sigmaAlbedo);
+		float invSigmaDepth = 1.0f / sigmaDepth;
+		int step = 1 << level;
+		parallelFor(0, b.height, numThreads, [&](int rowBegin, int rowEnd) {
+			filterRows(b, src, invSigmaColor2, invSigmaNormal2, invSigmaAlbedo2, invSigmaDepth, step, rowBegin, rowEnd);
+		});
+		src = 1 - src;
+		sigmaC *= 0.5f;
+	}
+
+	for(std::size_t k = 0; k < numPixels; k++)
+	{
+		out[k*3 + 0] = b.color[src][0][k];
+		out[k*3 + 1] = b.color[src][1][k];
+		out[k*3 + 2] = b.color[src][2][k];
+	}
+}
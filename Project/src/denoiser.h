@@ -0,0 +1,30 @@
+//denoiser.h
+#ifndef _DENOISER_H_
+#define _DENOISER_H_
+
+#include "framebuffer.h"
+
+// Edge-aware A-trous wavelet denoiser (Dammertz et al. 2010). Runs on the mean colour of the
+// accumulation buffer and is guided by the primary-hit normal, albedo and depth features, so
+// it smooths noise inside surfaces without blurring across geometric or texture edges.
+class Denoiser
+{
+private:
+	int iterations;    // Number of wavelet levels; the filter footprint doubles with every level
+	float sigmaColor;  // Colour tolerance of the first level; halved every level after that
+	float sigmaNormal;
+	float sigmaAlbedo;
+	float sigmaDepth;  // Relative depth tolerance
+	int numThreads;
+
+public:
+	Denoiser():
+		iterations(5), sigmaColor(0.6f), sigmaNormal(0.3f), sigmaAlbedo(0.1f), sigmaDepth(0.05f), numThreads(0) {}
+
+	void setIterations(int n) {iterations = n;}
+	void setThreads(int n) {numThreads = n;}
+
+	// Writes the denoised mean colour as interleaved RGB floats (width * height * 3)
+	void apply(const FrameBuffer& framebuffer, float *out) const;
+};
+#endif
@@ -0,0 +1,91 @@
+//displaytexture.cpp
+
+#include "displaytexture.h"
+
+DisplayTexture::DisplayTexture(int w, int h): width(w), height(h), next(0)
+{
+	glGenTextures(1, &texture);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glGenBuffers(2, buffers);
+	for(int b = 0; b < 2; b++)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[b]);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, GLsizeiptr(width) * height * 4, NULL, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+DisplayTexture::~DisplayTexture()
+{
+	glDeleteBuffers(2, buffers);
+	glDeleteTextures(1, &texture);
+}
+
+unsigned char* DisplayTexture::map()
+{
+	rects.clear();
+	return map(rects);
+}
+
+unsigned char* DisplayTexture::map(const std::vector<PixelRect>& regions)
+{
+	if(&regions != &rects)
+		rects = regions;
+	GLsizeiptr size = rects.empty() ? GLsizeiptr(width) * height * 4 : 0;
+	for(std::size_t r = 0; r < rects.size(); r++)
+		size += GLsizeiptr(rects[r].width) * rects[r].height * 4;
+
+	// Invalidating lets the driver hand out fresh storage instead of waiting for a copy that
+	// may still be reading this buffer
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[next]);
+	void *pixels = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if(!pixels)
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	return static_cast<unsigned char*>(pixels);
+}
+
+void DisplayTexture::upload()
+{
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[next]);
+	if(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+	{
+		// With a pixel unpack buffer bound, the data argument is an offset into it
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0); // Rows of each region are packed at its own width
+		if(rects.empty())
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (const void*)0);
+		std::size_t offset = 0;
+		for(std::size_t r = 0; r < rects.size(); r++)
+		{
+			const PixelRect& rect = rects[r];
+			glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y, rect.width, rect.height, GL_RGBA, GL_UNSIGNED_BYTE,
+			                (const void*)offset);
+			offset += std::size_t(rect.width) * rect.height * 4;
+		}
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	next = 1 - next;
+}
+
+void DisplayTexture::uploadRGB(const unsigned char *rgb)
+{
+	unsigned char *rgba = map();
+	if(!rgba)
+		return;
+	std::size_t numPixels = std::size_t(width) * height;
+	for(std::size_t k = 0; k < numPixels; k++)
+	{
+		rgba[k*4 + 0] = rgb[k*3 + 0];
+		rgba[k*4 + 1] = rgb[k*3 + 1];
+		rgba[k*4 + 2] = rgb[k*3 + 2];
+		rgba[k*4 + 3] = 255;
+	}
+	upload();
+}
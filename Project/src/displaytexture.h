@@ -0,0 +1,44 @@
+//displaytexture.h
+#ifndef _DISPLAYTEXTURE_H_
+#define _DISPLAYTEXTURE_H_
+
+#include <vector>
+#include "imgui_setup.h"
+#include "framebuffer.h"
+
+// RGBA8 texture showing the ray traced image, fed through two pixel buffer objects. A frame's
+// pixels are written straight into a mapped buffer and the texture update from it is queued,
+// so glTexSubImage2D returns at once and the copy to the GPU overlaps the next frame's work.
+// The two buffers alternate, so the buffer being written is never the one still being copied.
+// Four bytes per pixel keep every row 4-byte aligned, which is the driver's fast path.
+class DisplayTexture
+{
+private:
+	int width, height;
+	GLuint texture;
+	GLuint buffers[2];
+	int next; // Buffer written by the next frame
+	std::vector<PixelRect> rects; // Regions in the mapped buffer, empty for the whole image
+
+	DisplayTexture(const DisplayTexture&);
+	DisplayTexture& operator=(const DisplayTexture&);
+
+public:
+	DisplayTexture(int w, int h);
+	~DisplayTexture();
+
+	GLuint getTexture() const {return texture;}
+
+	// Maps the next buffer and returns width * height RGBA8 pixels to fill, bottom row first,
+	// or NULL if it cannot be mapped. Every map must be followed by upload().
+	unsigned char* map();
+	// Maps only enough of the next buffer for the given regions: each one's width * height pixels,
+	// packed one after the other, bottom row first. Only these regions are uploaded.
+	unsigned char* map(const std::vector<PixelRect>& regions);
+	// Unmaps the buffer and queues the texture update from it
+	void upload();
+
+	// Convenience for images that only exist as RGB, such as AOV channels
+	void uploadRGB(const unsigned char *rgb);
+};
+#endif
@@ -0,0 +1,17 @@
+//filepath.cpp
+
+#include "filepath.h"
+#include <cstring>
+#include <strings.h>
+
+bool hasExtension(const char *path, const char *extension)
+{
+	std::size_t n = std::strlen(path), e = std::strlen(extension);
+	return n >= e && strcasecmp(path + n - e, extension) == 0;
+}
+
+std::string directoryOf(const std::string& path)
+{
+	std::size_t slash = path.find_last_of("/\\");
+	return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
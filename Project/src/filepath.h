@@ -0,0 +1,12 @@
+//filepath.h
+#ifndef _FILEPATH_H_
+#define _FILEPATH_H_
+
+#include <string>
+
+// Whether path ends in extension, such as ".png", ignoring case
+bool hasExtension(const char *path, const char *extension);
+// Directory part of path with its trailing separator, empty for a bare file name
+std::string directoryOf(const std::string& path);
+
+#endif
@@ -0,0 +1,268 @@
+//framebuffer.cpp
+
+#include "framebuffer.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <math.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static inline float luminance(float r, float g, float b)
+{
+	return 0.2126f*r + 0.7152f*g + 0.0722f*b;
+}
+
+FrameBuffer::FrameBuffer(int w, int h) :
+width(w), height(h), tilesX((w + FRAMEBUFFER_TILE_SIZE - 1) / FRAMEBUFFER_TILE_SIZE), sharedMemory(NULL), sharedBytes(0)
+{
+	std::size_t n = getStorageSize();
+	accum = new float[n * 4];
+	sampleCount = new unsigned int[n];
+	lumSquares = new float[n];
+	features = new float[n * FEATURE_CHANNELS];
+	clear();
+}
+
+std::size_t FrameBuffer::getStorageSize() const
+{
+	std::size_t tilesY = (height + FRAMEBUFFER_TILE_SIZE - 1) / FRAMEBUFFER_TILE_SIZE;
+	return std::size_t(tilesX) * tilesY * FRAMEBUFFER_TILE_SIZE * FRAMEBUFFER_TILE_SIZE;
+}
+
+FrameBuffer::~FrameBuffer()
+{
+	if(sharedMemory)
+	{
+		munmap(sharedMemory, sharedBytes);
+		return;
+	}
+	delete []accum;
+	delete []sampleCount;
+	delete []lumSquares;
+	delete []features;
+}
+
+bool FrameBuffer::moveToSharedMemory(std::string& error)
+{
+	if(sharedMemory)
+		return true;
+	std::size_t n = getStorageSize();
+	std::size_t bytes = n * (4 + 1 + 1 + FEATURE_CHANNELS) * sizeof(float);
+	char name[64];
+	std::snprintf(name, sizeof(name), "/framebuffer-%d-%p", int(getpid()), (void*)this);
+	int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+	if(fd < 0)
+	{
+		error = std::string("cannot create shared memory for the frame buffer: ") + std::strerror(errno);
+		return false;
+	}
+	// The mapping, inherited by forked processes, keeps the memory alive without the name
+	shm_unlink(name);
+	void *memory = ftruncate(fd, bytes) == 0 ? mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	int mapError = errno;
+	close(fd);
+	if(memory == MAP_FAILED)
+	{
+		error = std::string("cannot map shared memory for the frame buffer: ") + std::strerror(mapError);
+		return false;
+	}
+
+	float *sharedAccum = static_cast<float*>(memory);
+	unsigned int *sharedSampleCount = reinterpret_cast<unsigned int*>(sharedAccum + n * 4);
+	float *sharedLumSquares = reinterpret_cast<float*>(sharedSampleCount + n);
+	float *sharedFeatures = sharedLumSquares + n;
+	std::copy(accum, accum + n * 4, sharedAccum);
+	std::copy(sampleCount, sampleCount + n, sharedSampleCount);
+	std::copy(lumSquares, lumSquares + n, sharedLumSquares);
+	std::copy(features, features + n * FEATURE_CHANNELS, sharedFeatures);
+	delete []accum;
+	delete []sampleCount;
+	delete []lumSquares;
+	delete []features;
+	accum = sharedAccum;
+	sampleCount = sharedSampleCount;
+	lumSquares = sharedLumSquares;
+	features = sharedFeatures;
+	sharedMemory = memory;
+	sharedBytes = bytes;
+	return true;
+}
+
+void FrameBuffer::clear()
+{
+	std::size_t n = getStorageSize();
+	std::fill(accum, accum + n * 4, 0.0f);
+	std::fill(sampleCount, sampleCount + n, 0u);
+	std::fill(lumSquares, lumSquares + n, 0.0f);
+	std::fill(features, features + n * FEATURE_CHANNELS, 0.0f);
+}
+
+bool FrameBuffer::write(FILE *file) const
+{
+	std::size_t n = getStorageSize();
+	return std::fwrite(accum, sizeof(float) * 4, n, file) == n && std::fwrite(sampleCount, sizeof(unsigned int), n, file) == n &&
+	       std::fwrite(lumSquares, sizeof(float), n, file) == n && std::fwrite(features, sizeof(float) * FEATURE_CHANNELS, n, file) == n;
+}
+
+bool FrameBuffer::read(FILE *file)
+{
+	std::size_t n = getStorageSize();
+	return std::fread(accum, sizeof(float) * 4, n, file) == n && std::fread(sampleCount, sizeof(unsigned int), n, file) == n &&
+	       std::fread(lumSquares, sizeof(float), n, file) == n && std::fread(features, sizeof(float) * FEATURE_CHANNELS, n, file) == n;
+}
+
+// Channels of the tile word layout, as the array holding them and its floats per pixel
+static inline void tileChannel(int c, float *accum, unsigned int *sampleCount, float *lumSquares, float *features,
+                               uint32_t*& base, int& stride, int& offset)
+{
+	if(c < 4)
+	{
+		base = reinterpret_cast<uint32_t*>(accum); stride = 4; offset = c;
+	}
+	else if(c == 4)
+	{
+		base = sampleCount; stride = 1; offset = 0;
+	}
+	else if(c == 5)
+	{
+		base = reinterpret_cast<uint32_t*>(lumSquares); stride = 1; offset = 0;
+	}
+	else
+	{
+		base = reinterpret_cast<uint32_t*>(features); stride = FEATURE_CHANNELS; offset = c - 6;
+	}
+}
+
+void FrameBuffer::getTile(int tile, uint32_t *words) const
+{
+	const std::size_t tilePixels = FRAMEBUFFER_TILE_SIZE * FRAMEBUFFER_TILE_SIZE, first = std::size_t(tile) * tilePixels;
+	for(int c = 0; c < FRAMEBUFFER_TILE_CHANNELS; c++)
+	{
+		uint32_t *base;
+		int stride, offset;
+		tileChannel(c, accum, sampleCount, lumSquares, features, base, stride, offset);
+		const uint32_t *in = base + first * stride + offset;
+		for(std::size_t p = 0; p < tilePixels; p++)
+			*words++ = in[p * stride];
+	}
+}
+
+void FrameBuffer::setTile(int tile, const uint32_t *words)
+{
+	const std::size_t tilePixels = FRAMEBUFFER_TILE_SIZE * FRAMEBUFFER_TILE_SIZE, first = std::size_t(tile) * tilePixels;
+	for(int c = 0; c < FRAMEBUFFER_TILE_CHANNELS; c++)
+	{
+		uint32_t *base;
+		int stride, offset;
+		tileChannel(c, accum, sampleCount, lumSquares, features, base, stride, offset);
+		uint32_t *out = base + first * stride + offset;
+		for(std::size_t p = 0; p < tilePixels; p++)
+			out[p * stride] = *words++;
+	}
+}
+
+void FrameBuffer::addSample(int i, int j, const Color& c)
+{
+	std::size_t index = getIndex(i, j);
+	float *p = accum + index*4;
+	p[0] += c.r;
+	p[1] += c.g;
+	p[2] += c.b;
+	p[3] += 1.0f;
+	sampleCount[index]++;
+	float l = luminance(c.r, c.g, c.b);
+	lumSquares[index] += l*l;
+}
+
+void FrameBuffer::addFeatures(int i, int j, const Vector3D& normal, const Color& albedo, float depth)
+{
+	float *f = features + getIndex(i, j) * FEATURE_CHANNELS;
+	f[0] += normal.X();
+	f[1] += normal.Y();
+	f[2] += normal.Z();
+	f[3] += albedo.r;
+	f[4] += albedo.g;
+	f[5] += albedo.b;
+	f[6] += depth;
+}
+
+void FrameBuffer::getFeatures(int i, int j, float out[]) const
+{
+	std::size_t index = getIndex(i, j);
+	unsigned int n = sampleCount[index];
+	float inv = n ? 1.0f/n : 0.0f;
+	const float *f = features + index * FEATURE_CHANNELS;
+	for(int c = 0; c < FEATURE_CHANNELS; c++)
+		out[c] = f[c] * inv;
+}
+
+Color FrameBuffer::getMean(int i, int j) const
+{
+	std::size_t index = getIndex(i, j);
+	unsigned int n = sampleCount[index];
+	if(n == 0)
+		return Color(0.0);
+	const float *p = accum + index*4;
+	return Color(p[0]/n, p[1]/n, p[2]/n);
+}
+
+float FrameBuffer::relativeError(int i, int j) const
+{
+	std::size_t index = getIndex(i, j);
+	unsigned int n = sampleCount[index];
+	if(n < 2)
+		return FLT_MAX;
+	const float *p = accum + index*4;
+	float mean = luminance(p[0], p[1], p[2]) / n;
+	float variance = std::max(0.0f, (lumSquares[index] - n*mean*mean) / (n - 1));
+	float standardError = sqrtf(variance / n);
+	// Floor the mean so errors in near-black pixels are measured on an absolute scale
+	return standardError / std::max(mean, 0.01f);
+}
+
+// Straight-line loop with no data dependent branches so the compiler can vectorize it;
+// Channels is a template parameter so the store stride is a constant
+template<int Channels>
+static void resolvePixels(const float *accum, const unsigned int *sampleCount, std::size_t numPixels, unsigned char *bitmap)
+{
+	for(std::size_t k = 0; k < numPixels; k++)
+	{
+		float inv = sampleCount[k] ? 1.0f/sampleCount[k] : 0.0f;
+		for(int c = 0; c < 3; c++)
+		{
+			float v = accum[k*4 + c] * inv;
+			v = std::min(std::max(v, 0.0f), 1.0f);
+			bitmap[k*Channels + c] = (unsigned char)(255.0f * v);
+		}
+		if(Channels == 4)
+			bitmap[k*Channels + 3] = 255;
+	}
+}
+
+void FrameBuffer::resolve(unsigned char *bitmap, int channels) const
+{
+	PixelRect all = {0, 0, width, height};
+	resolve(bitmap, channels, all);
+}
+
+void FrameBuffer::resolve(unsigned char *pixels, int channels, const PixelRect& rect) const
+{
+	// Each row of the rectangle is a run of contiguous pixels in every tile it crosses
+	for(int j = rect.y; j < rect.y + rect.height; j++)
+	{
+		unsigned char *row = pixels + std::size_t(j - rect.y) * rect.width * channels;
+		for(int i = rect.x; i < rect.x + rect.width; )
+		{
+			int run = std::min(FRAMEBUFFER_TILE_SIZE - i % FRAMEBUFFER_TILE_SIZE, rect.x + rect.width - i);
+			std::size_t first = getIndex(i, j);
+			unsigned char *out = row + std::size_t(i - rect.x) * channels;
+			if(channels == 4)
+				resolvePixels<4>(accum + first*4, sampleCount + first, run, out);
+			else
+				resolvePixels<3>(accum + first*4, sampleCount + first, run, out);
+			i += run;
+		}
+	}
+}
@@ -0,0 +1,89 @@
+//framebuffer.h
+#ifndef _FRAMEBUFFER_H_
+#define _FRAMEBUFFER_H_
+
+#include "color.h"
+#include "vector3D.h"
+#include <cstdio>
+#include <stdint.h>
+#include <float.h>
+#include <string>
+
+// Number of feature channels per pixel: normal (3), albedo (3), depth (1)
+#define FEATURE_CHANNELS 7
+
+// Pixels are stored in square tiles of this size, each tile's rows one after the other, so a
+// tile being rendered covers a few contiguous pages instead of one cache line in each of its rows.
+// Only resolve() converts to the row-major layout of images.
+#define FRAMEBUFFER_TILE_SIZE 32
+
+// 32-bit words per pixel in a tile's raw contents: RGBA sums, sample count, squared luminance sum and features
+#define FRAMEBUFFER_TILE_CHANNELS (6 + FEATURE_CHANNELS)
+#define FRAMEBUFFER_TILE_WORDS (FRAMEBUFFER_TILE_SIZE * FRAMEBUFFER_TILE_SIZE * FRAMEBUFFER_TILE_CHANNELS)
+
+// Rectangle of pixels, x and y being the lowest column and row
+struct PixelRect
+{
+	int x, y, width, height;
+};
+
+// Linear HDR accumulation buffer. Every sample is added unclamped to a float RGBA
+// running sum, and the 8-bit display image is produced by a separate resolve pass.
+class FrameBuffer
+{
+private:
+	int width, height;
+	int tilesX; // Tiles per row of tiles; partial tiles at the right and top edges are padded
+	float *accum;              // RGBA running sum; alpha accumulates coverage
+	unsigned int *sampleCount; // Number of samples added to each pixel
+	float *lumSquares;         // Running sum of squared sample luminance, for the variance estimate
+	float *features;           // Primary hit feature sums (normal xyz, albedo rgb, depth), guiding the denoiser
+	void *sharedMemory;        // Mapping holding all four arrays once moved to shared memory, else NULL
+	std::size_t sharedBytes;
+
+	std::size_t getIndex(int i, int j) const
+	{
+		return (std::size_t(j / FRAMEBUFFER_TILE_SIZE) * tilesX + i / FRAMEBUFFER_TILE_SIZE) * (FRAMEBUFFER_TILE_SIZE * FRAMEBUFFER_TILE_SIZE) +
+		       (j % FRAMEBUFFER_TILE_SIZE) * FRAMEBUFFER_TILE_SIZE + i % FRAMEBUFFER_TILE_SIZE;
+	}
+	std::size_t getStorageSize() const; // Pixels including padding
+
+public:
+	FrameBuffer(int w, int h);
+	~FrameBuffer();
+
+	void clear();
+	// Moves the contents into a shm_open mapping, which processes forked afterwards share, so
+	// samples any of them adds are seen by all. Returns false and sets error if it cannot be mapped.
+	bool moveToSharedMemory(std::string& error);
+	void addSample(int i, int j, const Color& c);
+	// Adds the primary-hit features of a sample to pixel (i, j)'s running sums
+	void addFeatures(int i, int j, const Vector3D& normal, const Color& albedo, float depth);
+
+	int getWidth() const {return width;}
+	int getHeight() const {return height;}
+	unsigned int getSampleCount(int i, int j) const {return sampleCount[getIndex(i, j)];}
+	Color getMean(int i, int j) const;
+	// Mean features of pixel (i, j) in the layout of FEATURE_CHANNELS
+	void getFeatures(int i, int j, float out[]) const;
+
+	// Standard error of the pixel's mean luminance relative to the mean itself.
+	// Needs at least two samples; returns FLT_MAX before that.
+	float relativeError(int i, int j) const;
+
+	// Raw contents, for checkpoints; read() expects a file written by a frame buffer of the same size
+	bool write(FILE *file) const;
+	bool read(FILE *file);
+	// Raw contents of storage tile number tile, counted row by row of tiles, as FRAMEBUFFER_TILE_WORDS
+	// words: one channel's words for all the tile's pixels after the other. For moving tiles between
+	// frame buffers of the same width.
+	int getNumTiles() const {return int(getStorageSize() / (FRAMEBUFFER_TILE_SIZE * FRAMEBUFFER_TILE_SIZE));}
+	void getTile(int tile, uint32_t *words) const;
+	void setTile(int tile, const uint32_t *words);
+
+	// Convert the running mean to clamped 8-bit RGB, or RGBA with opaque alpha if channels is 4
+	void resolve(unsigned char *bitmap, int channels = 3) const;
+	// Resolve only rect, into width * height packed pixels starting with its row y
+	void resolve(unsigned char *pixels, int channels, const PixelRect& rect) const;
+};
+#endif
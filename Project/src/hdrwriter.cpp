@@ -0,0 +1,265 @@
+//hdrwriter.cpp
+
+#include "hdrwriter.h"
+#include "filepath.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <vector>
+
+// Rows come from either the frame buffer's running mean or a float image, bottom row first
+struct FrameBufferRows
+{
+	const FrameBuffer& framebuffer;
+
+	int getWidth() const {return framebuffer.getWidth();}
+	int getHeight() const {return framebuffer.getHeight();}
+	void getRow(int j, float *rgb) const
+	{
+		for(int i = 0; i < framebuffer.getWidth(); i++)
+		{
+			Color c = framebuffer.getMean(i, j);
+			rgb[i*3 + 0] = (float)c.r;
+			rgb[i*3 + 1] = (float)c.g;
+			rgb[i*3 + 2] = (float)c.b;
+		}
+	}
+};
+
+struct FloatRows
+{
+	int width, height;
+	const float *rgb;
+
+	int getWidth() const {return width;}
+	int getHeight() const {return height;}
+	void getRow(int j, float *row) const
+	{
+		std::memcpy(row, rgb + std::size_t(j) * width * 3, std::size_t(width) * 3 * sizeof(float));
+	}
+};
+
+static inline void put16(std::vector<unsigned char>& out, uint32_t x)
+{
+	out.push_back((unsigned char)x);
+	out.push_back((unsigned char)(x >> 8));
+}
+
+static inline void put32(std::vector<unsigned char>& out, uint32_t x)
+{
+	put16(out, x & 0xFFFF);
+	put16(out, x >> 16);
+}
+
+static inline void putFloat(std::vector<unsigned char>& out, float f)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &f, sizeof(bits));
+	put32(out, bits);
+}
+
+static inline void putString(std::vector<unsigned char>& out, const char *s)
+{
+	out.insert(out.end(), s, s + std::strlen(s) + 1);
+}
+
+// Rounds to the nearest half, ties to even, keeping infinities and NaN and going through
+// half denormals to zero
+static uint16_t floatToHalf(float value)
+{
+	uint32_t f;
+	std::memcpy(&f, &value, sizeof(f));
+	uint32_t sign = (f >> 16) & 0x8000;
+	uint32_t magnitude = f & 0x7FFFFFFF;
+	if(magnitude >= 0x7F800000)
+		return (uint16_t)(sign | 0x7C00 | (magnitude > 0x7F800000 ? 0x200 : 0));
+	if(magnitude >= 0x477FF000) // 65520 and up round past the largest half, 65504
+		return (uint16_t)(sign | 0x7C00);
+	if(magnitude < 0x38800000) // Below the smallest normal half, 2^-14
+	{
+		if(magnitude < 0x33000000) // Half of the smallest denormal, 2^-25, or less
+			return (uint16_t)sign;
+		uint32_t mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+		int shift = 126 - int(magnitude >> 23);
+		uint32_t half = mantissa >> shift;
+		uint32_t rest = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+		if(rest > halfway || (rest == halfway && (half & 1)))
+			half++;
+		return (uint16_t)(sign | half);
+	}
+	// Rebias the exponent from 127 to 15; rounding up may carry into the exponent, as it should
+	uint32_t rebiased = magnitude - 0x38000000;
+	uint32_t half = rebiased >> 13, rest = rebiased & 0x1FFF;
+	if(rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+		half++;
+	return (uint16_t)(sign | half);
+}
+
+static FILE* createFile(const char *path, std::string& error)
+{
+	FILE *file = std::fopen(path, "wb");
+	if(!file)
+		error = std::string("cannot create ") + path + ": " + std::strerror(errno);
+	return file;
+}
+
+static bool finishFile(FILE *file, bool ok, const char *path, std::string& error)
+{
+	if(std::fclose(file) != 0)
+		ok = false;
+	if(!ok)
+		error = std::string("error writing ") + path;
+	return ok;
+}
+
+template<typename Rows>
+static bool writePFMRows(const char *path, const Rows& rows, std::string& error)
+{
+	FILE *file = createFile(path, error);
+	if(!file)
+		return false;
+	// A negative scale marks little-endian data. PFM rows run bottom to top, as ours do.
+	const int width = rows.getWidth(), height = rows.getHeight();
+	bool ok = std::fprintf(file, "PF\n%d %d\n-1.0\n", width, height) > 0;
+	std::vector<float> row(std::size_t(width) * 3);
+	std::vector<unsigned char> bytes;
+	for(int j = 0; j < height && ok; j++)
+	{
+		rows.getRow(j, row.data());
+		bytes.clear();
+		for(std::size_t k = 0; k < row.size(); k++)
+			putFloat(bytes, row[k]);
+		ok = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+	}
+	return finishFile(file, ok, path, error);
+}
+
+// Header attribute: name, type, size and value
+static void putAttribute(std::vector<unsigned char>& out, const char *name, const char *type,
+                         const std::vector<unsigned char>& value)
+{
+	putString(out, name);
+	putString(out, type);
+	put32(out, (uint32_t)value.size());
+	out.insert(out.end(), value.begin(), value.end());
+}
+
+template<typename Rows>
+static bool writeEXRRows(const char *path, const Rows& rows, std::string& error)
+{
+	FILE *file = createFile(path, error);
+	if(!file)
+		return false;
+	const int width = rows.getWidth(), height = rows.getHeight();
+
+	std::vector<unsigned char> header, value;
+	put32(header, 20000630); // Magic number
+	put32(header, 2);        // Version 2, single-part scanline file
+
+	// Channels are listed in alphabetical order, each stored as half with no subsampling
+	const char *channels[3] = {"B", "G", "R"};
+	for(int c = 0; c < 3; c++)
+	{
+		putString(value, channels[c]);
+		put32(value, 1); // HALF
+		put32(value, 0); // pLinear and reserved bytes
+		put32(value, 1); // x sampling
+		put32(value, 1); // y sampling
+	}
+	value.push_back(0);
+	putAttribute(header, "channels", "chlist", value);
+	value.assign(1, 0); // NO_COMPRESSION
+	putAttribute(header, "compression", "compression", value);
+	value.clear();
+	put32(value, 0);
+	put32(value, 0);
+	put32(value, width - 1);
+	put32(value, height - 1);
+	putAttribute(header, "dataWindow", "box2i", value);
+	putAttribute(header, "displayWindow", "box2i", value);
+	value.assign(1, 0); // INCREASING_Y
+	putAttribute(header, "lineOrder", "lineOrder", value);
+	value.clear();
+	putFloat(value, 1.0f);
+	putAttribute(header, "pixelAspectRatio", "float", value);
+	value.clear();
+	putFloat(value, 0.0f);
+	putFloat(value, 0.0f);
+	putAttribute(header, "screenWindowCenter", "v2f", value);
+	value.clear();
+	putFloat(value, 1.0f);
+	putAttribute(header, "screenWindowWidth", "float", value);
+	header.push_back(0);
+
+	// Uncompressed blocks all have the same size, so the offset table is known before any pixel:
+	// one block per scanline holding its y, its data size, then each channel's row of halves
+	const uint32_t dataSize = uint32_t(width) * 3 * 2;
+	uint64_t offset = header.size() + uint64_t(height) * 8;
+	for(int y = 0; y < height; y++)
+	{
+		put32(header, uint32_t(offset));
+		put32(header, uint32_t(offset >> 32));
+		offset += 8 + dataSize;
+	}
+	bool ok = std::fwrite(header.data(), 1, header.size(), file) == header.size();
+
+	// EXR's y grows downwards, so the top row comes first
+	std::vector<float> row(std::size_t(width) * 3);
+	std::vector<unsigned char> block;
+	for(int y = 0; y < height && ok; y++)
+	{
+		rows.getRow(height - 1 - y, row.data());
+		block.clear();
+		put32(block, (uint32_t)y);
+		put32(block, dataSize);
+		for(int c = 2; c >= 0; c--)
+			for(int i = 0; i < width; i++)
+				put16(block, floatToHalf(row[i*3 + c]));
+		ok = std::fwrite(block.data(), 1, block.size(), file) == block.size();
+	}
+	return finishFile(file, ok, path, error);
+}
+
+bool writePFM(const char *path, const FrameBuffer& framebuffer, std::string& error)
+{
+	FrameBufferRows rows = {framebuffer};
+	return writePFMRows(path, rows, error);
+}
+
+bool writePFM(const char *path, int width, int height, const float *rgb, std::string& error)
+{
+	FloatRows rows = {width, height, rgb};
+	return writePFMRows(path, rows, error);
+}
+
+bool writeEXR(const char *path, const FrameBuffer& framebuffer, std::string& error)
+{
+	FrameBufferRows rows = {framebuffer};
+	return writeEXRRows(path, rows, error);
+}
+
+bool writeEXR(const char *path, int width, int height, const float *rgb, std::string& error)
+{
+	FloatRows rows = {width, height, rgb};
+	return writeEXRRows(path, rows, error);
+}
+
+bool isHDRImagePath(const char *path)
+{
+	return hasExtension(path, ".pfm") || hasExtension(path, ".exr");
+}
+
+bool writeHDRImage(const char *path, const FrameBuffer& framebuffer, std::string& error)
+{
+	if(hasExtension(path, ".exr"))
+		return writeEXR(path, framebuffer, error);
+	return writePFM(path, framebuffer, error);
+}
+
+bool writeHDRImage(const char *path, int width, int height, const float *rgb, std::string& error)
+{
+	if(hasExtension(path, ".exr"))
+		return writeEXR(path, width, height, rgb, error);
+	return writePFM(path, width, height, rgb, error);
+}
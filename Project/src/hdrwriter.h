@@ -0,0 +1,26 @@
+//hdrwriter.h
+#ifndef _HDRWRITER_H_
+#define _HDRWRITER_H_
+
+#include <string>
+#include "framebuffer.h"
+
+// Linear, unclamped float images for compositing. Both formats are written one row at a time
+// straight from the source, so the only extra memory is a row buffer. Returns false and sets
+// error if the file cannot be written.
+
+// Portable float map: three 32-bit floats per pixel, little-endian
+bool writePFM(const char *path, const FrameBuffer& framebuffer, std::string& error);
+// The same from interleaved RGB floats, bottom row first, such as the denoiser's output
+bool writePFM(const char *path, int width, int height, const float *rgb, std::string& error);
+
+// Single-part scanline OpenEXR with half-float B, G and R channels and no compression
+bool writeEXR(const char *path, const FrameBuffer& framebuffer, std::string& error);
+bool writeEXR(const char *path, int width, int height, const float *rgb, std::string& error);
+
+// True if path names one of the formats above
+bool isHDRImagePath(const char *path);
+bool writeHDRImage(const char *path, const FrameBuffer& framebuffer, std::string& error);
+bool writeHDRImage(const char *path, int width, int height, const float *rgb, std::string& error);
+
+#endif
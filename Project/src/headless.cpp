@@ -0,0 +1,535 @@
+//headless.cpp
+// Command line renderer: builds a scene, renders it on all cores and writes the image,
+// without creating a window. Links against the core library only (no GLFW, GLEW or OpenGL).
+
+#include "camera.h"
+#include "renderengine.h"
+#include "world.h"
+#include "scenes.h"
+#include "sceneloader.h"
+#include "sampler.h"
+#include "denoiser.h"
+#include "aov.h"
+#include "mappedfile.h"
+#include "pngwriter.h"
+#include "hdrwriter.h"
+#include "imagestream.h"
+#include "checkpoint.h"
+#include "netrender.h"
+#include "processpool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static void printUsage(const char *program)
+{
+    std::cout << "Usage: " << program << " [options]" << std::endl;
+    std::cout << "  --scene N            Built-in scene 1-" << NUM_SCENES << " (default 1)" << std::endl;
+    std::cout << "  --scene-file FILE    Load a text or compiled scene instead of a built-in one" << std::endl;
+    std::cout << "  --compile FILE       Compile the text --scene-file into FILE and exit" << std::endl;
+    std::cout << "  --compress-meshes    Store mesh vertices quantized to 16 bits and indices to 8" << std::endl;
+    std::cout << "  --memory-budget MB   Render compiled scenes larger than this out of core (default half of RAM)" << std::endl;
+    std::cout << "  --width W            Image width (default 1280)" << std::endl;
+    std::cout << "  --height H           Image height (default 720)" << std::endl;
+    std::cout << "  --spp N              Samples per pixel (default 16)" << std::endl;
+    std::cout << "  --threads N          Render threads, 0 = all cores (default 0); per process with --processes" << std::endl;
+    std::cout << "  --processes N        Render in N processes forked after the scene is built (default 1)" << std::endl;
+    std::cout << "  --sampler NAME       random, stratified, halton, sobol or bluenoise (default sobol)" << std::endl;
+    std::cout << "  --adaptive T         Adaptive sampling with noise threshold T, up to 4x spp" << std::endl;
+    std::cout << "  --denoise            Run the denoiser on the finished image" << std::endl;
+    std::cout << "  --mode MODE          normal, depth or aov (default normal)" << std::endl;
+    std::cout << "  --band-rows N        Render N rows at a time, writing each band to a .ppm or .pfm --output" << std::endl;
+    std::cout << "  --checkpoint FILE    Save progress to FILE periodically and at the end; resume from it if it exists" << std::endl;
+    std::cout << "  --checkpoint-interval S  Seconds between checkpoints (default 300)" << std::endl;
+    std::cout << "  --coordinator ADDR   Composite the image from --worker processes on unix:PATH or [HOST]:PORT" << std::endl;
+    std::cout << "  --worker ADDR        Render tiles for the coordinator at ADDR, given the same scene and settings" << std::endl;
+    std::cout << "  --job-tiles N        Tiles of a row handed to a worker at a time (default 8)" << std::endl;
+    std::cout << "  --stall-timeout S    Reissue a worker's tiles after S seconds without news from it (default 60)" << std::endl;
+    std::cout << "  --output FILE        Output PNG, or linear float .pfm or .exr; aov mode writes FILE_<channel>.png (default img.png)" << std::endl;
+    std::cout << std::endl;
+    std::cout << "SIGUSR1 writes the image so far to FILE_partial.png, FILE being --output without its extension, and the render goes on" << std::endl;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Out-of-core scenes are paged in while rendering, so the fault rate is part of the render stats
+static void printPageFaults(long major, long minor, double seconds)
+{
+    long majorNow, minorNow;
+    getPageFaults(majorNow, minorNow);
+    std::cout << "Page faults: " << majorNow - major << " major (" << (majorNow - major) / seconds << "/s), "
+              << minorNow - minor << " minor" << std::endl;
+}
+
+static volatile std::sig_atomic_t partialImageRequested = 0;
+
+static void requestPartialImage(int)
+{
+    partialImageRequested = 1;
+}
+
+// Identifies what the samples in a checkpoint were taken of, including the adaptive threshold that
+// chose the pixels to sample (0 without --adaptive). The sample count is left out so that a later
+// run can add samples to a checkpoint. A text or mesh scene file counts as changed when its
+// modification time does, so workers on other machines are best given a compiled scene.
+static bool hashRender(const char *sceneFile, int scene, int width, int height, const std::string& mode, bool compressMeshes,
+                       float noiseThreshold, uint64_t& hash, std::string& error)
+{
+    hash = hashBytes(NULL, 0);
+    if(sceneFile && !hashSceneFile(sceneFile, hash, error))
+        return false;
+    int settings[5] = {sceneFile ? 0 : scene, width, height, mode == "depth", compressMeshes};
+    hash = hashBytes(settings, sizeof(settings), hash);
+    hash = hashBytes(&noiseThreshold, sizeof(noiseThreshold), hash);
+    return true;
+}
+
+// Workers must also agree on the samples they take, which a checkpoint can add to
+static bool hashJob(const char *sceneFile, int scene, int width, int height, const std::string& mode, bool compressMeshes,
+                    int samplesPerPixel, float noiseThreshold, const Sampler& sampler, uint64_t& hash, std::string& error)
+{
+    if(!hashRender(sceneFile, scene, width, height, mode, compressMeshes, noiseThreshold, hash, error))
+        return false;
+    hash = hashBytes(&samplesPerPixel, sizeof(samplesPerPixel), hash);
+    hash = hashBytes(sampler.getName(), std::strlen(sampler.getName()), hash);
+    return true;
+}
+
+static std::string stripExtension(const std::string& path)
+{
+    std::size_t dot = path.rfind('.');
+    std::size_t slash = path.find_last_of("/\\");
+    if(dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return path;
+    return path.substr(0, dot);
+}
+
+// Writes the camera's frame buffer to output as a PNG, or as float .pfm or .exr, denoised first if asked
+static int writeImage(Camera *camera, int width, int height, const std::string& output, bool denoise, int numThreads)
+{
+    std::chrono::steady_clock::time_point start;
+    Denoiser denoiser;
+    denoiser.setThreads(numThreads);
+    if(isHDRImagePath(output.c_str()))
+    {
+        // Written unclamped from the running mean, or from the denoiser's float output
+        std::string error;
+        bool ok;
+        start = std::chrono::steady_clock::now();
+        if(denoise)
+        {
+            std::vector<float> denoised(std::size_t(width) * height * 3);
+            denoiser.apply(*camera->getFrameBuffer(), denoised.data());
+            std::cout << "Denoised in " << secondsSince(start) << " s" << std::endl;
+            start = std::chrono::steady_clock::now();
+            ok = writeHDRImage(output.c_str(), width, height, denoised.data(), error);
+        }
+        else
+            ok = writeHDRImage(output.c_str(), *camera->getFrameBuffer(), error);
+        if(!ok)
+        {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        std::cout << "Encoded in " << secondsSince(start) << " s" << std::endl;
+        std::cout << "Wrote " << output << std::endl;
+        return 0;
+    }
+    if(denoise)
+    {
+        camera->setDenoiser(&denoiser);
+        start = std::chrono::steady_clock::now();
+    }
+    camera->resolve(denoise);
+    if(denoise)
+        std::cout << "Denoised in " << secondsSince(start) << " s" << std::endl;
+
+    // The camera's bitmap is bottom-up, as OpenGL expects
+    start = std::chrono::steady_clock::now();
+    std::string error;
+    if(!writePNG(output.c_str(), width, height, 3, camera->getBitmap(), true, numThreads, error))
+    {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    std::cout << "Encoded in " << secondsSince(start) << " s" << std::endl;
+    std::cout << "Wrote " << output << std::endl;
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    // Installed first: SIGUSR1's default action would kill a process still loading its scene.
+    // A request that arrives before rendering is served after the first pass.
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = requestPartialImage;
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, NULL);
+
+    int scene = 1;
+    const char *sceneFile = NULL;
+    const char *compileTo = NULL;
+    int width = 1280, height = 720;
+    int samplesPerPixel = 16;
+    int numThreads = 0;
+    int numProcesses = 1;
+    const char *samplerName = "sobol";
+    float noiseThreshold = 0.0f;
+    bool denoise = false;
+    std::string mode = "normal";
+    std::string output = "img.png";
+    int bandRows = 0;
+    bool compressMeshes = false;
+    const char *checkpointPath = NULL;
+    double checkpointInterval = 300.0;
+    const char *coordinatorAddress = NULL;
+    const char *workerAddress = NULL;
+    int jobTiles = 8;
+    double stallTimeout = 60.0;
+
+    for(int a = 1; a < argc; a++)
+    {
+        std::string arg = argv[a];
+        bool hasValue = a + 1 < argc;
+        if(arg == "--help" || arg == "-h")
+        {
+            printUsage(argv[0]);
+            return 0;
+        }
+        else if(arg == "--denoise")
+            denoise = true;
+        else if(arg == "--compress-meshes")
+            compressMeshes = true;
+        else if(!hasValue)
+        {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return 1;
+        }
+        else if(arg == "--scene") scene = std::atoi(argv[++a]);
+        else if(arg == "--scene-file") sceneFile = argv[++a];
+        else if(arg == "--compile") compileTo = argv[++a];
+        else if(arg == "--memory-budget") setSceneMemoryBudget(std::size_t(std::atof(argv[++a]) * (1 << 20)));
+        else if(arg == "--width") width = std::atoi(argv[++a]);
+        else if(arg == "--height") height = std::atoi(argv[++a]);
+        else if(arg == "--spp") samplesPerPixel = std::atoi(argv[++a]);
+        else if(arg == "--threads") numThreads = std::atoi(argv[++a]);
+        else if(arg == "--processes") numProcesses = std::atoi(argv[++a]);
+        else if(arg == "--sampler") samplerName = argv[++a];
+        else if(arg == "--adaptive") noiseThreshold = (float)std::atof(argv[++a]);
+        else if(arg == "--mode") mode = argv[++a];
+        else if(arg == "--output") output = argv[++a];
+        else if(arg == "--band-rows") bandRows = std::atoi(argv[++a]);
+        else if(arg == "--checkpoint") checkpointPath = argv[++a];
+        else if(arg == "--checkpoint-interval") checkpointInterval = std::atof(argv[++a]);
+        else if(arg == "--coordinator") coordinatorAddress = argv[++a];
+        else if(arg == "--worker") workerAddress = argv[++a];
+        else if(arg == "--job-tiles") jobTiles = std::atoi(argv[++a]);
+        else if(arg == "--stall-timeout") stallTimeout = std::atof(argv[++a]);
+        else
+        {
+            std::cerr << "Unknown option " << arg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(scene < 1 || scene > NUM_SCENES || width <= 0 || height <= 0 || samplesPerPixel <= 0)
+    {
+        std::cerr << "Invalid scene, size or sample count" << std::endl;
+        return 1;
+    }
+    if(mode != "normal" && mode != "depth" && mode != "aov")
+    {
+        std::cerr << "Unknown mode " << mode << std::endl;
+        return 1;
+    }
+
+    if(bandRows < 0 || (bandRows > 0 && (mode == "aov" || denoise || !ImageStream::canStream(output.c_str()))))
+    {
+        std::cerr << "--band-rows needs a .ppm or .pfm --output and works without --denoise or aov mode" << std::endl;
+        return 1;
+    }
+    if(checkpointPath && (bandRows > 0 || mode == "aov"))
+    {
+        std::cerr << "--checkpoint works without --band-rows or aov mode" << std::endl;
+        return 1;
+    }
+    if((coordinatorAddress || workerAddress) &&
+       ((coordinatorAddress && workerAddress) || bandRows > 0 || checkpointPath || mode == "aov" || compileTo || jobTiles <= 0))
+    {
+        std::cerr << "--coordinator and --worker exclude each other, --band-rows, --checkpoint, --compile and aov mode" << std::endl;
+        return 1;
+    }
+    if(numProcesses < 1 || (numProcesses > 1 && (bandRows > 0 || mode == "aov" || coordinatorAddress || workerAddress)))
+    {
+        std::cerr << "--processes needs a positive count and works without --band-rows, aov mode, --coordinator and --worker" << std::endl;
+        return 1;
+    }
+    setMeshCompression(compressMeshes);
+
+    if(compileTo)
+    {
+        std::string error;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if(!sceneFile || !compileSceneFile(sceneFile, compileTo, error))
+        {
+            std::cerr << (sceneFile ? error : std::string("--compile needs a --scene-file")) << std::endl;
+            return 1;
+        }
+        std::cout << "Compiled " << sceneFile << " into " << compileTo << " in " << secondsSince(start) << " s" << std::endl;
+        return 0;
+    }
+
+    Sampler *sampler = createSampler(samplerName, samplesPerPixel);
+    if(!sampler)
+    {
+        std::cerr << "Unknown sampler " << samplerName << std::endl;
+        return 1;
+    }
+
+    uint64_t jobHash = 0;
+    if(coordinatorAddress || workerAddress)
+    {
+        std::string error;
+        if(!hashJob(sceneFile, scene, width, height, mode, compressMeshes, samplesPerPixel, noiseThreshold, *sampler, jobHash, error))
+        {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+    }
+    if(coordinatorAddress)
+    {
+        // The coordinator only composites tiles, so it never loads the scene
+        Camera *camera = createSceneCamera(width, height, 1);
+        NetRenderStats stats;
+        std::string error;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if(!runCoordinator(coordinatorAddress, jobHash, jobTiles, stallTimeout, *camera->getFrameBuffer(), stats,
+                           [](const std::string& message) {std::cout << message << std::endl;}, error))
+        {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        std::cout << "Composited " << width << "x" << height << " from " << stats.workers << " workers in " << secondsSince(start)
+                  << " s, " << stats.reissuedJobs << " jobs reissued, tiles compressed to "
+                  << 100.0 * stats.compressedBytes / stats.rawBytes << "%" << std::endl;
+        delete sampler;
+        return writeImage(camera, width, height, output, denoise, numThreads);
+    }
+
+    // When streaming, and on workers, the camera's buffers hold one band; setBand restores the image's geometry
+    int cameraRows = bandRows > 0 ? std::min(bandRows, height) : workerAddress ? std::min(FRAMEBUFFER_TILE_SIZE, height) : height;
+    Camera *camera;
+    World *world;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if(sceneFile)
+    {
+        SceneLoadStats stats;
+        std::string error;
+        world = loadSceneFile(sceneFile, width, cameraRows, 1, mode == "depth", camera, stats, error);
+        if(!world)
+        {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        std::cout << (stats.binary ? "Mapped " : "Parsed ") << stats.numPrimitives << " primitives in " << stats.parseSeconds
+                  << " s, built in " << stats.buildSeconds << " s" << (stats.outOfCore ? " (out of core)" : "") << std::endl;
+        if(stats.meshTriangles > 0)
+        {
+            std::cout << "Meshes: " << stats.meshTriangles << " triangles in " << stats.meshBytes / 1048576.0 << " MB, "
+                      << double(stats.meshBytes) / stats.meshTriangles << " bytes per triangle";
+            if(stats.meshError > 0.0f)
+                std::cout << ", max vertex error " << stats.meshError;
+            std::cout << std::endl;
+        }
+    }
+    else
+    {
+        camera = createSceneCamera(width, cameraRows, 1);
+        world = buildScene(scene, camera, mode == "depth");
+        std::cout << "Scene " << scene << " built in " << secondsSince(start) << " s" << std::endl;
+    }
+
+    if(workerAddress)
+    {
+        NetRenderStats stats;
+        std::string error;
+        camera->setBand(height, 0, cameraRows);
+        start = std::chrono::steady_clock::now();
+        if(!runWorker(workerAddress, jobHash, world, camera, *sampler, samplesPerPixel, noiseThreshold, numThreads, stats, error))
+        {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        std::cout << "Rendered " << stats.jobs << " jobs of " << stats.tiles << " tiles (" << sampler->getName() << ") in "
+                  << secondsSince(start) << " s" << std::endl;
+        delete sampler;
+        return 0;
+    }
+
+    long majorFaults, minorFaults;
+    if(mode == "aov")
+    {
+        start = std::chrono::steady_clock::now();
+        AOVBuffer aovs(width, height);
+        getPageFaults(majorFaults, minorFaults);
+        aovs.render(world, camera, numThreads);
+        double renderTime = secondsSince(start);
+        std::cout << "AOVs rendered in " << renderTime << " s" << std::endl;
+        printPageFaults(majorFaults, minorFaults, renderTime);
+
+        std::string prefix = stripExtension(output);
+        std::string error;
+        for(int c = 0; c < AOVBuffer::NUM_CHANNELS; c++)
+        {
+            std::string filename = prefix + "_" + AOVBuffer::getChannelName((AOVBuffer::Channel)c) + ".png";
+            aovs.toBitmap((AOVBuffer::Channel)c, camera->getBitmap());
+            if(!writePNG(filename.c_str(), width, height, 3, camera->getBitmap(), true, numThreads, error))
+            {
+                std::cerr << error << std::endl;
+                return 1;
+            }
+            std::cout << "Wrote " << filename << std::endl;
+        }
+        delete sampler;
+        return 0;
+    }
+
+    if(bandRows > 0)
+    {
+        // Only one band is in memory at a time: it is written out and its buffers reused for the next
+        ImageStream stream;
+        std::string error;
+        if(!stream.open(output.c_str(), width, height, error))
+        {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        start = std::chrono::steady_clock::now();
+        getPageFaults(majorFaults, minorFaults);
+        int numBands = (height + bandRows - 1) / bandRows;
+        for(int b = 0; b < numBands; b++)
+        {
+            // PPM starts with the top row, so its bands are rendered from the top of the image
+            int band = stream.isBottomUp() ? b : numBands - 1 - b;
+            int first = band * bandRows;
+            camera->setBand(height, first, std::min(bandRows, height - first));
+
+            RenderEngine engine(world, camera, 1);
+            engine.setSampler(sampler->clone());
+            engine.setProgressive(samplesPerPixel);
+            if(noiseThreshold > 0.0f)
+                engine.setAdaptive(noiseThreshold, 4 * samplesPerPixel);
+            engine.render(numThreads);
+            if(!stream.writeBand(*camera->getFrameBuffer(), error))
+            {
+                std::cerr << error << std::endl;
+                return 1;
+            }
+        }
+        if(!stream.close(error))
+        {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        double renderTime = secondsSince(start);
+        std::cout << "Rendered " << width << "x" << height << " in " << numBands << " bands of " << bandRows << " rows ("
+                  << sampler->getName() << ") in " << renderTime << " s" << std::endl;
+        printPageFaults(majorFaults, minorFaults, renderTime);
+        std::cout << "Wrote " << output << std::endl;
+        delete sampler;
+        return 0;
+    }
+
+    RenderEngine engine(world, camera, 1);
+    engine.setSampler(sampler);
+    engine.setProgressive(samplesPerPixel);
+    if(noiseThreshold > 0.0f)
+        engine.setAdaptive(noiseThreshold, 4 * samplesPerPixel);
+
+    uint64_t sceneHash = 0;
+    if(checkpointPath)
+    {
+        // A higher --spp than the checkpoint's adds samples to it; a finished one at the same --spp is written out again
+        std::string error;
+        if(!hashRender(sceneFile, scene, width, height, mode, compressMeshes, noiseThreshold, sceneHash, error) ||
+           (!readCheckpoint(checkpointPath, sceneHash, *camera->getFrameBuffer(), engine, error) && !error.empty()))
+        {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        if(engine.getPass() > 0)
+            std::cout << "Resumed " << checkpointPath << " after " << engine.getPass() << " passes" << std::endl;
+    }
+
+    RenderProcessPool processes;
+    if(numProcesses > 1)
+    {
+        std::string error;
+        if(!processes.start(&engine, camera->getFrameBuffer(), numProcesses, numThreads, error))
+        {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+    }
+
+    start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point lastCheckpoint = start;
+    getPageFaults(majorFaults, minorFaults);
+    while(!engine.isDone())
+    {
+        // Both are handled between passes, while no thread is writing to the frame buffer
+        if(numProcesses > 1)
+        {
+            std::string error;
+            if(!processes.renderPass(error))
+            {
+                std::cerr << error << std::endl;
+                return 1;
+            }
+        }
+        else
+            engine.renderPass(numThreads);
+        if(partialImageRequested)
+        {
+            partialImageRequested = 0;
+            std::string partial = stripExtension(output) + "_partial.png", error;
+            camera->resolve();
+            if(writePNG(partial.c_str(), width, height, 3, camera->getBitmap(), true, numThreads, error))
+                std::cout << "Wrote " << partial << " after " << engine.getPass() << " passes" << std::endl;
+            else
+                std::cerr << error << std::endl;
+        }
+        if(checkpointPath && !engine.isDone() && secondsSince(lastCheckpoint) >= checkpointInterval)
+        {
+            std::string error;
+            if(!writeCheckpoint(checkpointPath, sceneHash, *camera->getFrameBuffer(), engine, error))
+                std::cerr << error << std::endl;
+            lastCheckpoint = std::chrono::steady_clock::now();
+        }
+    }
+    if(checkpointPath)
+    {
+        std::string error;
+        if(!writeCheckpoint(checkpointPath, sceneHash, *camera->getFrameBuffer(), engine, error))
+            std::cerr << error << std::endl;
+    }
+    processes.stop();
+    double renderTime = secondsSince(start);
+    std::cout << "Rendered " << width << "x" << height << " with " << engine.getPass() << " passes ("
+              << sampler->getName() << ")" << (numProcesses > 1 ? " in " + std::to_string(numProcesses) + " processes" : "")
+              << " in " << renderTime << " s" << std::endl;
+    printPageFaults(majorFaults, minorFaults, renderTime);
+
+    return writeImage(camera, width, height, output, denoise, numThreads);
+}
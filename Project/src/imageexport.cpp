@@ -0,0 +1,59 @@
+//imageexport.cpp
+
+#include "imageexport.h"
+#include "pngwriter.h"
+#include <exception>
+
+ImageExporter::~ImageExporter()
+{
+	if(worker.joinable())
+		worker.join();
+}
+
+bool ImageExporter::start(const std::string& path, int width, int height, int channels, unsigned char *pixels, int numThreads)
+{
+	if(busy)
+	{
+		delete []pixels;
+		return false;
+	}
+	if(worker.joinable())
+		worker.join();
+
+	busy = true;
+	rowsDone = 0;
+	totalRows = height;
+	worker = std::thread([this, path, width, height, channels, pixels, numThreads]() {
+		std::string error;
+		bool ok;
+		try
+		{
+			ok = writePNG(path.c_str(), width, height, channels, pixels, true, numThreads, error, &rowsDone);
+		}
+		catch(const std::exception& e)
+		{
+			ok = false;
+			error = path + ": " + e.what();
+		}
+		delete []pixels;
+		{
+			std::lock_guard<std::mutex> lock(statusMutex);
+			status = ok ? "Wrote " + path : error;
+			failed = !ok;
+		}
+		busy = false;
+	});
+	return true;
+}
+
+std::string ImageExporter::getStatus() const
+{
+	std::lock_guard<std::mutex> lock(statusMutex);
+	return status;
+}
+
+bool ImageExporter::hasFailed() const
+{
+	std::lock_guard<std::mutex> lock(statusMutex);
+	return failed;
+}
@@ -0,0 +1,41 @@
+//imageexport.h
+#ifndef _IMAGEEXPORT_H_
+#define _IMAGEEXPORT_H_
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Writes PNG files on a background thread, so the caller never waits for the encoder. The
+// exporter takes its own copy of the image when an export starts, and the caller polls for
+// progress and the outcome. One export runs at a time.
+class ImageExporter
+{
+private:
+	std::thread worker;
+	std::atomic<bool> busy;
+	std::atomic<int> rowsDone;
+	int totalRows;
+	mutable std::mutex statusMutex;
+	std::string status;
+	bool failed;
+
+	ImageExporter(const ImageExporter&);
+	ImageExporter& operator=(const ImageExporter&);
+
+public:
+	ImageExporter(): busy(false), rowsDone(0), totalRows(0), failed(false) {}
+	~ImageExporter(); // Waits for a running export to finish
+
+	// Starts writing width x height 8-bit pixels, bottom row first, and takes ownership of pixels
+	// (allocated with new[]). Returns false, deleting pixels, if an export is still running.
+	bool start(const std::string& path, int width, int height, int channels, unsigned char *pixels, int numThreads = 0);
+
+	bool isBusy() const {return busy;}
+	float getProgress() const {return totalRows > 0 ? (float)rowsDone / totalRows : 0.0f;}
+	// Message about the last finished export, empty before the first one
+	std::string getStatus() const;
+	bool hasFailed() const;
+};
+#endif
@@ -0,0 +1,99 @@
+//imagestream.cpp
+
+#include "imagestream.h"
+#include "filepath.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdint.h>
+#include <vector>
+
+ImageStream::~ImageStream()
+{
+	if(file)
+		std::fclose(file);
+}
+
+bool ImageStream::canStream(const char *path)
+{
+	return hasExtension(path, ".ppm") || hasExtension(path, ".pfm");
+}
+
+bool ImageStream::open(const char *p, int w, int h, std::string& error)
+{
+	path = p;
+	width = w;
+	height = h;
+	floats = hasExtension(p, ".pfm");
+	rowsWritten = 0;
+	file = std::fopen(p, "wb");
+	if(!file)
+	{
+		error = "cannot create " + path + ": " + std::strerror(errno);
+		return false;
+	}
+	// A negative PFM scale marks little-endian data
+	int written = floats ? std::fprintf(file, "PF\n%d %d\n-1.0\n", width, height) : std::fprintf(file, "P6\n%d %d\n255\n", width, height);
+	if(written <= 0)
+	{
+		error = "error writing " + path;
+		return false;
+	}
+	return true;
+}
+
+bool ImageStream::writeBand(const FrameBuffer& band, std::string& error)
+{
+	const int rows = band.getHeight();
+	if(!file || band.getWidth() != width || rowsWritten + rows > height)
+	{
+		error = "band does not fit " + path;
+		return false;
+	}
+	std::vector<unsigned char> bytes(std::size_t(width) * (floats ? 12 : 3));
+	bool ok = true;
+	for(int r = 0; r < rows && ok; r++)
+	{
+		int j = floats ? r : rows - 1 - r;
+		unsigned char *out = bytes.data();
+		for(int i = 0; i < width; i++)
+		{
+			Color c = band.getMean(i, j);
+			float rgb[3] = {(float)c.r, (float)c.g, (float)c.b};
+			for(int k = 0; k < 3; k++)
+				if(floats)
+				{
+					uint32_t bits;
+					std::memcpy(&bits, &rgb[k], sizeof(bits));
+					for(int b = 0; b < 4; b++)
+						*out++ = (unsigned char)(bits >> (8 * b));
+				}
+				else
+					*out++ = (unsigned char)(255.0f * std::min(std::max(rgb[k], 0.0f), 1.0f));
+		}
+		ok = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+	}
+	if(!ok || std::fflush(file) != 0)
+	{
+		error = "error writing " + path;
+		return false;
+	}
+	rowsWritten += rows;
+	return true;
+}
+
+bool ImageStream::close(std::string& error)
+{
+	if(!file)
+		return false;
+	bool ok = std::fclose(file) == 0;
+	file = NULL;
+	if(!ok)
+		error = "error writing " + path;
+	else if(rowsWritten != height)
+	{
+		error = path + ": only " + std::to_string(rowsWritten) + " of " + std::to_string(height) + " rows written";
+		ok = false;
+	}
+	return ok;
+}
@@ -0,0 +1,41 @@
+//imagestream.h
+#ifndef _IMAGESTREAM_H_
+#define _IMAGESTREAM_H_
+
+#include <cstdio>
+#include <string>
+#include "framebuffer.h"
+
+// Image file written band by band as the bands are rendered, for images too large to hold in
+// memory at once: binary PPM (8-bit, as resolve() converts) or little-endian PFM (linear float).
+// Each band is flushed to the file when written, so the rows finished before a crash survive.
+// Bands must come in file order, which is top to bottom for PPM and bottom to top for PFM.
+class ImageStream
+{
+private:
+	FILE *file;
+	std::string path;
+	int width, height;
+	bool floats;
+	int rowsWritten;
+
+	ImageStream(const ImageStream&);
+	ImageStream& operator=(const ImageStream&);
+
+public:
+	ImageStream(): file(NULL), width(0), height(0), floats(false), rowsWritten(0) {}
+	~ImageStream();
+
+	// True if path names a format that can be streamed
+	static bool canStream(const char *path);
+
+	// Creates the file and writes its header. Returns false and sets error on failure.
+	bool open(const char *path, int w, int h, std::string& error);
+	// False for PPM, whose first row is the top one
+	bool isBottomUp() const {return floats;}
+	// Appends the running mean of every row of band, in file order
+	bool writeBand(const FrameBuffer& band, std::string& error);
+	// Fails if any row was not written
+	bool close(std::string& error);
+};
+#endif
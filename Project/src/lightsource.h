@@ -7,12 +7,18 @@
 
 class LightSource
 {	
+public:
+	// Type tag so shading can pick the concrete light without a dynamic_cast
+	enum Type { POINT };
+
 protected:
 	World *world;
 	Color intensity;
+	Type type;
 public:
-	LightSource(World *_world, const Color _intensity):
-		world(_world), intensity(_intensity)   {}
+	LightSource(World *_world, const Color _intensity, Type _type):
+		world(_world), intensity(_intensity), type(_type)   {}
+	Type getType() const {return type; }
 	virtual Vector3D getPosition() const = 0;
 	Color getIntensity() const {return intensity; }
 
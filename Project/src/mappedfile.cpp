@@ -0,0 +1,79 @@
+//mappedfile.cpp
+
+#include "mappedfile.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool MappedFile::open(const char *path, std::string& error)
+{
+	close();
+	int fd = ::open(path, O_RDONLY);
+	if(fd < 0)
+	{
+		error = std::string("cannot open ") + path + ": " + std::strerror(errno);
+		return false;
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		error = std::string("cannot map empty or unreadable file ") + path;
+		::close(fd);
+		return false;
+	}
+	void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); // The mapping keeps its own reference to the file
+	if(p == MAP_FAILED)
+	{
+		error = std::string("cannot map ") + path + ": " + std::strerror(errno);
+		return false;
+	}
+	data = static_cast<const char*>(p);
+	size = st.st_size;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if(data)
+		munmap(const_cast<char*>(data), size);
+	data = NULL;
+	size = 0;
+}
+
+void MappedFile::swap(MappedFile& other)
+{
+	std::swap(data, other.data);
+	std::swap(size, other.size);
+}
+
+void MappedFile::advise(std::size_t offset, std::size_t length, Access access) const
+{
+	if(!data || offset >= size)
+		return;
+	static const int advice[] = {MADV_NORMAL, MADV_RANDOM, MADV_SEQUENTIAL, MADV_WILLNEED};
+	// madvise needs a page-aligned start
+	std::size_t page = sysconf(_SC_PAGESIZE);
+	std::size_t begin = offset / page * page;
+	std::size_t end = std::min(offset + std::min(length, size), size);
+	madvise(const_cast<char*>(data) + begin, end - begin, advice[access]);
+}
+
+std::size_t physicalMemory()
+{
+	long pages = sysconf(_SC_PHYS_PAGES), page = sysconf(_SC_PAGESIZE);
+	return pages > 0 && page > 0 ? std::size_t(pages) * std::size_t(page) : 0;
+}
+
+void getPageFaults(long& major, long& minor)
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	major = usage.ru_majflt;
+	minor = usage.ru_minflt;
+}
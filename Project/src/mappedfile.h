@@ -0,0 +1,47 @@
+//mappedfile.h
+#ifndef _MAPPEDFILE_H_
+#define _MAPPEDFILE_H_
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file. Pages are loaded by the OS on first touch, so
+// opening even a very large file is immediate.
+class MappedFile
+{
+private:
+	const char *data;
+	std::size_t size;
+
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+public:
+	MappedFile(): data(NULL), size(0) {}
+	~MappedFile() {close();}
+
+	// Returns false and sets error if the file cannot be opened or mapped
+	bool open(const char *path, std::string& error);
+	void close();
+	void swap(MappedFile& other); // Hands a mapping over without unmapping it
+
+	bool isOpen() const {return data != NULL;}
+	const char* getData() const {return data;}
+	std::size_t getSize() const {return size;}
+
+	enum Access {ACCESS_NORMAL, ACCESS_RANDOM, ACCESS_SEQUENTIAL, ACCESS_WILLNEED};
+
+	// Paging hint for [offset, offset + length). ACCESS_RANDOM turns off readahead, which
+	// matters once the file no longer fits in memory.
+	void advise(std::size_t offset, std::size_t length, Access access) const;
+
+	// Ask the OS to start reading [offset, offset + length) in the background
+	void prefetch(std::size_t offset, std::size_t length) const {advise(offset, length, ACCESS_WILLNEED);}
+};
+
+// Physical memory of the machine in bytes, or 0 if unknown
+std::size_t physicalMemory();
+
+// Page faults of the process so far: major faults had to read from disk, minor ones did not
+void getPageFaults(long& major, long& minor);
+#endif
@@ -4,10 +4,7 @@
 #include "lightsource.h"
 #include "pointlightsource.h"
 
-#include <typeinfo>
-#include "sphere.h"
-#include "triangle.h"
-#include "transformedSurface.h"
+#include "primitives.h"
 
 #include <iostream>
 #include <ostream>
@@ -143,8 +140,10 @@ Color Material::shade(const Ray& incident, const bool isSolid) const
         // Iterate through the light sources
         for (const LightSource* lightSource : lightSources)
         {
-            if (const PointLightSource* pointLight = dynamic_cast<const PointLightSource*>(lightSource))
+            if (lightSource->getType() == LightSource::POINT)
             {
+                const PointLightSource* pointLight = static_cast<const PointLightSource*>(lightSource);
+
                 // Get the position of the point light source
                 Vector3D lightPos = pointLight->getPosition();
 
@@ -158,48 +157,64 @@ Color Material::shade(const Ray& incident, const bool isSolid) const
                 // Check for shadows
                 Ray shadowRay(hitPointPosition, -lightDirection);
                 bool inShadow = false;
+                bool stopSearch = false;
 
                 for (const Object* object : world->getObjectList())
                 {
-                    if (dynamic_cast<const Sphere*>(object) != nullptr)
+                    switch (object->getType())
                     {
-                        // The object is a Sphere
-                        const Sphere* sphere = dynamic_cast<const Sphere*>(object);
-                        if (sphere->intersect(shadowRay))
-                        {
-                            // The shadow ray intersects an object; the point is in shadow
-                            inShadow = true;
+                        case Object::SPHERE:
+                            if (static_cast<const Sphere*>(object)->intersect(shadowRay))
+                            {
+                                // The shadow ray intersects an object; the point is in shadow
+                                inShadow = true;
+                            }
                             break;
-                        }
-                    }
-                    else if (dynamic_cast<const Triangle*>(object) != nullptr)
-                    {
-                        // The object is a Triangle
-                        const Triangle* triangle = dynamic_cast<const Triangle*>(object);
-                        if (triangle->intersect(shadowRay))
-                        {
-                            // The shadow ray intersects an object; the point is in shadow
-                            inShadow = true;
+
+                        case Object::TRIANGLE:
+                            if (static_cast<const Triangle*>(object)->intersect(shadowRay))
+                            {
+                                // The shadow ray intersects an object; the point is in shadow
+                                inShadow = true;
+                            }
                             break;
-                        }
-                    }
-                    else if (dynamic_cast<const TransformedSurface*>(object) != nullptr)
-                    {
-                        // The object is a TransformedSurface
-                        const TransformedSurface* transformedSurface = dynamic_cast<const TransformedSurface*>(object);
 
-                        // Access the transform matrix
-                        const TransformMatrix* transformMatrix = transformedSurface->transform;
+                        case Object::SPHERE_SET:
+                            if (static_cast<const SphereSet*>(object)->intersect(shadowRay))
+                                inShadow = true;
+                            break;
 
-                        shadowRay.transform(*transformMatrix);
+                        case Object::MESH:
+                            if (static_cast<const TriangleMesh*>(object)->intersect(shadowRay))
+                                inShadow = true;
+                            break;
 
-                        if (transformedSurface->intersect(shadowRay))
+                        case Object::COMPRESSED_MESH:
+                            if (static_cast<const CompressedMesh*>(object)->intersect(shadowRay))
+                                inShadow = true;
+                            break;
+
+                        case Object::TRANSFORMED_SURFACE:
                         {
-                            // The shadow ray intersects an object; the point is in shadow
-                            inShadow = false;
+                            const TransformedSurface* transformedSurface = static_cast<const TransformedSurface*>(object);
+
+                            // Access the transform matrix
+                            const TransformMatrix* transformMatrix = transformedSurface->transform;
+
+                            shadowRay.transform(*transformMatrix);
+
+                            if (transformedSurface->intersect(shadowRay))
+                            {
+                                // A transformed surface ends the search without casting a shadow
+                                inShadow = false;
+                                stopSearch = true;
+                            }
                             break;
                         }
                     }
+
+                    if (inShadow || stopSearch)
+                        break;
                 }
 
                 if(inShadow)
@@ -250,10 +265,10 @@ Color Material::shade(const Ray& incident, const bool isSolid) const
                     totalLightColor = totalLightColor + objectColor * lightColor;
 
                     // Calculate Diffuse lighting (affected by object's color)
-                    Color diffuseColor = objectColor * lightColor * kd * std::max(dotProduct(lightDirection, normal), 0.0);
+                    Color diffuseColor = objectColor * lightColor * kd * std::max<double>(dotProduct(lightDirection, normal), 0.0);
 
                     // Calculate Specular lighting (not affected by object's color)
-                    Color specularColor = lightColor * ks * (pow(std::max(dotProduct(normal, halfVector), 0.0), n));
+                    Color specularColor = lightColor * ks * (pow(std::max<double>(dotProduct(normal, halfVector), 0.0), n));
 
                     // Combine Diffuse, Specular
                     finalColor = finalColor  + diffuseColor + specularColor;
@@ -264,9 +279,6 @@ Color Material::shade(const Ray& incident, const bool isSolid) const
         // Calculate Ambient lighting
         ambientColor = totalLightColor * ka;
 
-        // Set ambient in the world
-        world->setAmbient(ambientColor);
-
         // Finally add the amalgamated ambient lighting
         finalColor = finalColor + ambientColor;
     }
@@ -26,10 +26,11 @@ public:
 	double n;   // Phong's shiny constant
     float C;    // Attenuation Constant
     bool dp;    // Depth map
+    int id;     // Index in the world's material list, -1 until the material is used by an object
 
 	Material(World *w, Camera *c):
 		world(w), color(0), camera(c),
-		ka(0), kd(0.0), ks(0), kr(0), kt(0),n(0), eta(0) {}
+		ka(0), kd(0.0), ks(0), kr(0), kt(0),n(0), eta(0), id(-1) {}
 	Color shade(const Ray& incident, const bool isSolid) const;
 };
 #endif
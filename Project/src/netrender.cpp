@@ -0,0 +1,609 @@
+//netrender.cpp
+
+#include "netrender.h"
+#include "renderengine.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <thread>
+#include <vector>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define NET_MAGIC "LUMNET01"
+#define NET_BYTE_ORDER 0x01020304u
+#define NET_MAX_MESSAGE (1 << 20)
+#define NET_CONNECT_SECONDS 10
+#define NET_JOBS_QUEUED 2 // Jobs sent ahead to each worker, so it never waits for the next one
+
+#define TILE_BYTES (FRAMEBUFFER_TILE_WORDS * 4)
+
+enum MessageType
+{
+	MSG_HELLO = 1, // Worker: NetHello
+	MSG_REJECT,    // Coordinator: the reason, as text
+	MSG_ASSIGN,    // Coordinator: first tile and number of tiles of a job
+	MSG_PROGRESS,  // Worker: passes completed of its current job
+	MSG_TILE,      // Worker: tile number and compressed contents
+	MSG_JOB_DONE,  // Worker: first tile of the job whose tiles have all been sent
+	MSG_FINISH     // Coordinator: the image is complete
+};
+
+struct MessageHeader
+{
+	uint32_t type;
+	uint32_t size; // Bytes of payload that follow
+};
+
+struct NetHello
+{
+	char magic[8];
+	uint32_t byteOrder;
+	uint32_t reserved;
+	uint64_t jobHash;
+};
+
+// Tiles are compressed losslessly. Each channel's words are XORed with the previous pixel's, which
+// zeroes the sign, exponent and leading mantissa bits that neighbouring pixels share, and split into
+// byte planes, high bytes first, so those zeros line up into runs. The planes are then run-length
+// coded: a control byte below 128 precedes that many plus one literal bytes, and one of 128 or more
+// repeats the next byte control - 125 times.
+static void flushLiterals(const std::vector<unsigned char>& planes, std::size_t& literal, std::size_t end, std::vector<unsigned char>& out)
+{
+	while(literal < end)
+	{
+		std::size_t count = std::min<std::size_t>(end - literal, 128);
+		out.push_back((unsigned char)(count - 1));
+		out.insert(out.end(), planes.begin() + literal, planes.begin() + literal + count);
+		literal += count;
+	}
+}
+
+static void compressTile(const uint32_t *words, std::vector<unsigned char>& out)
+{
+	const int tilePixels = FRAMEBUFFER_TILE_SIZE * FRAMEBUFFER_TILE_SIZE;
+	std::vector<unsigned char> planes(TILE_BYTES);
+	for(int c = 0; c < FRAMEBUFFER_TILE_CHANNELS; c++)
+	{
+		const uint32_t *channel = words + c * tilePixels;
+		unsigned char *plane = &planes[std::size_t(c) * tilePixels * 4];
+		uint32_t previous = 0;
+		for(int p = 0; p < tilePixels; p++)
+		{
+			uint32_t delta = channel[p] ^ previous;
+			previous = channel[p];
+			for(int b = 0; b < 4; b++)
+				plane[b * tilePixels + p] = (unsigned char)(delta >> (24 - 8 * b));
+		}
+	}
+
+	std::size_t k = 0, literal = 0;
+	while(k < planes.size())
+	{
+		std::size_t run = 1;
+		while(k + run < planes.size() && run < 130 && planes[k + run] == planes[k])
+			run++;
+		if(run < 3)
+		{
+			k++;
+			continue;
+		}
+		flushLiterals(planes, literal, k, out);
+		out.push_back((unsigned char)(run + 125));
+		out.push_back(planes[k]);
+		k += run;
+		literal = k;
+	}
+	flushLiterals(planes, literal, k, out);
+}
+
+// Returns false if data is not a whole compressed tile
+static bool decompressTile(const unsigned char *data, std::size_t size, uint32_t *words)
+{
+	std::vector<unsigned char> planes(TILE_BYTES);
+	std::size_t k = 0, n = 0;
+	while(k < size)
+	{
+		std::size_t control = data[k++];
+		if(control < 128)
+		{
+			std::size_t count = control + 1;
+			if(count > size - k || count > planes.size() - n)
+				return false;
+			std::memcpy(&planes[n], data + k, count);
+			k += count;
+			n += count;
+		}
+		else
+		{
+			std::size_t count = control - 125;
+			if(k == size || count > planes.size() - n)
+				return false;
+			std::memset(&planes[n], data[k++], count);
+			n += count;
+		}
+	}
+	if(n != planes.size())
+		return false;
+
+	const int tilePixels = FRAMEBUFFER_TILE_SIZE * FRAMEBUFFER_TILE_SIZE;
+	for(int c = 0; c < FRAMEBUFFER_TILE_CHANNELS; c++)
+	{
+		uint32_t *channel = words + c * tilePixels;
+		const unsigned char *plane = &planes[std::size_t(c) * tilePixels * 4];
+		uint32_t previous = 0;
+		for(int p = 0; p < tilePixels; p++)
+		{
+			uint32_t delta = 0;
+			for(int b = 0; b < 4; b++)
+				delta |= uint32_t(plane[b * tilePixels + p]) << (24 - 8 * b);
+			previous ^= delta;
+			channel[p] = previous;
+		}
+	}
+	return true;
+}
+
+static bool sendMessage(int fd, uint32_t type, const void *payload, std::size_t size)
+{
+	// Header and payload in one send, so small messages go out as one packet
+	MessageHeader header = {type, uint32_t(size)};
+	std::vector<unsigned char> message((const unsigned char*)&header, (const unsigned char*)&header + sizeof(header));
+	message.insert(message.end(), (const unsigned char*)payload, (const unsigned char*)payload + size);
+
+	const unsigned char *data = message.data();
+	std::size_t left = message.size();
+	while(left > 0)
+	{
+		ssize_t sent = send(fd, data, left, MSG_NOSIGNAL);
+		if(sent < 0 && errno == EINTR)
+			continue;
+		if(sent <= 0)
+			return false;
+		data += sent;
+		left -= sent;
+	}
+	return true;
+}
+
+static bool receiveAll(int fd, void *data, std::size_t size)
+{
+	unsigned char *bytes = static_cast<unsigned char*>(data);
+	while(size > 0)
+	{
+		ssize_t received = recv(fd, bytes, size, 0);
+		if(received < 0 && errno == EINTR)
+			continue;
+		if(received <= 0)
+			return false;
+		bytes += received;
+		size -= received;
+	}
+	return true;
+}
+
+static bool receiveMessage(int fd, uint32_t& type, std::vector<unsigned char>& payload)
+{
+	MessageHeader header;
+	if(!receiveAll(fd, &header, sizeof(header)) || header.size > NET_MAX_MESSAGE)
+		return false;
+	type = header.type;
+	payload.resize(header.size);
+	return header.size == 0 || receiveAll(fd, payload.data(), header.size);
+}
+
+// Returns a socket listening on, or connected to, address, or -1 with error set
+static int openSocket(const char *address, bool listening, std::string& error)
+{
+	std::string spec = address;
+	const char *action = listening ? "cannot listen on " : "cannot connect to ";
+	int one = 1;
+	if(spec.compare(0, 5, "unix:") == 0)
+	{
+		std::string path = spec.substr(5);
+		sockaddr_un addr;
+		std::memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if(path.empty() || path.size() >= sizeof(addr.sun_path))
+		{
+			error = action + spec + ": invalid socket path";
+			return -1;
+		}
+		std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if(listening)
+			unlink(path.c_str()); // Left behind by an earlier coordinator
+		bool ok = fd >= 0 && (listening ? bind(fd, (sockaddr*)&addr, sizeof(addr)) == 0 && listen(fd, 64) == 0 :
+		                                  connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0);
+		if(!ok)
+		{
+			error = action + spec + ": " + std::strerror(errno);
+			if(fd >= 0)
+				close(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+	std::size_t colon = spec.rfind(':');
+	if(colon == std::string::npos)
+	{
+		error = action + spec + ": expected unix:PATH or HOST:PORT";
+		return -1;
+	}
+	std::string host = spec.substr(0, colon), port = spec.substr(colon + 1);
+	addrinfo hints, *list;
+	std::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = listening ? AI_PASSIVE : 0;
+	int status = getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &list);
+	if(status != 0)
+	{
+		error = action + spec + ": " + gai_strerror(status);
+		return -1;
+	}
+	int fd = -1, lastError = 0;
+	for(addrinfo *ai = list; ai && fd < 0; ai = ai->ai_next)
+	{
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if(fd < 0)
+		{
+			lastError = errno;
+			continue;
+		}
+		if(listening)
+			setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		bool ok = listening ? bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 64) == 0 :
+		                      connect(fd, ai->ai_addr, ai->ai_addrlen) == 0;
+		if(!ok)
+		{
+			lastError = errno;
+			close(fd);
+			fd = -1;
+		}
+	}
+	freeaddrinfo(list);
+	if(fd < 0)
+		error = action + spec + ": " + std::strerror(lastError);
+	else if(!listening)
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	return fd;
+}
+
+static double secondsBetween(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+	return std::chrono::duration<double>(end - start).count();
+}
+
+struct Job
+{
+	int first, count; // Tiles, counted row by row of tiles
+};
+
+struct WorkerConnection
+{
+	int fd; // -1 once dropped
+	int id;
+	bool greeted;
+	std::vector<unsigned char> input; // Received bytes not handled yet
+	std::deque<Job> jobs;             // Sent and not done, in the order the worker renders them
+	std::chrono::steady_clock::time_point lastHeard;
+};
+
+bool runCoordinator(const char *address, uint64_t jobHash, int jobTiles, double stallTimeout, FrameBuffer& framebuffer,
+                    NetRenderStats& stats, const std::function<void(const std::string&)>& log, std::string& error)
+{
+	int listener = openSocket(address, true, error);
+	if(listener < 0)
+		return false;
+
+	const int tilesX = (framebuffer.getWidth() + FRAMEBUFFER_TILE_SIZE - 1) / FRAMEBUFFER_TILE_SIZE;
+	const int numTiles = framebuffer.getNumTiles();
+	std::deque<Job> pending;
+	for(int first = 0; first < numTiles; first += tilesX)
+		for(int x = 0; x < tilesX; x += jobTiles)
+		{
+			Job job = {first + x, std::min(jobTiles, tilesX - x)};
+			pending.push_back(job);
+		}
+	std::vector<bool> received(numTiles, false);
+	int tilesLeft = numTiles, nextReport = 1, nextId = 1;
+	std::vector<WorkerConnection> connections;
+	std::vector<uint32_t> words(FRAMEBUFFER_TILE_WORDS);
+	log("Waiting for workers on " + std::string(address));
+
+	// Jobs of a lost worker go back to the front of the queue
+	auto drop = [&](WorkerConnection& connection, const std::string& reason) {
+		int reissued = int(connection.jobs.size());
+		for(std::deque<Job>::reverse_iterator job = connection.jobs.rbegin(); job != connection.jobs.rend(); ++job)
+			pending.push_front(*job);
+		connection.jobs.clear();
+		stats.reissuedJobs += reissued;
+		close(connection.fd);
+		connection.fd = -1;
+		log("Worker " + std::to_string(connection.id) + " " + reason +
+		    (reissued > 0 ? ", reissuing " + std::to_string(reissued) + " jobs" : ""));
+	};
+	auto isComplete = [&](const Job& job) {
+		for(int t = job.first; t < job.first + job.count; t++)
+			if(!received[t])
+				return false;
+		return true;
+	};
+	// Done jobs are waited for even once every tile is in, so no worker is cut off mid-message
+	auto hasJobs = [&]() {
+		for(std::size_t w = 0; w < connections.size(); w++)
+			if(!connections[w].jobs.empty())
+				return true;
+		return false;
+	};
+
+	while(tilesLeft > 0 || hasJobs())
+	{
+		std::vector<pollfd> fds(connections.size() + 1);
+		fds[0].fd = listener;
+		fds[0].events = POLLIN;
+		for(std::size_t w = 0; w < connections.size(); w++)
+		{
+			fds[w + 1].fd = connections[w].fd;
+			fds[w + 1].events = POLLIN;
+		}
+		if(poll(fds.data(), fds.size(), 250) < 0 && errno != EINTR)
+		{
+			error = std::string("error waiting for workers: ") + std::strerror(errno);
+			break;
+		}
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+		for(std::size_t w = 0; w < connections.size(); w++)
+		{
+			WorkerConnection& connection = connections[w];
+			if(!(fds[w + 1].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+			unsigned char buffer[65536];
+			ssize_t n = recv(connection.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+			if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+				continue;
+			if(n <= 0)
+			{
+				drop(connection, "disconnected");
+				continue;
+			}
+			connection.input.insert(connection.input.end(), buffer, buffer + n);
+			connection.lastHeard = now;
+
+			std::size_t used = 0;
+			while(connection.fd >= 0 && connection.input.size() - used >= sizeof(MessageHeader))
+			{
+				MessageHeader header;
+				std::memcpy(&header, &connection.input[used], sizeof(header));
+				if(header.size > NET_MAX_MESSAGE || (!connection.greeted && header.type != MSG_HELLO))
+				{
+					drop(connection, "sent a corrupt message");
+					break;
+				}
+				if(connection.input.size() - used - sizeof(header) < header.size)
+					break;
+				const unsigned char *payload = &connection.input[used + sizeof(header)];
+				used += sizeof(header) + header.size;
+
+				int32_t value = 0;
+				if(header.size >= sizeof(value))
+					std::memcpy(&value, payload, sizeof(value));
+				if(header.type == MSG_HELLO)
+				{
+					NetHello hello;
+					std::memset(&hello, 0, sizeof(hello));
+					if(header.size == sizeof(hello))
+						std::memcpy(&hello, payload, sizeof(hello));
+					std::string reason;
+					if(std::memcmp(hello.magic, NET_MAGIC, sizeof(hello.magic)) != 0 || hello.byteOrder != NET_BYTE_ORDER)
+						reason = "incompatible protocol or byte order";
+					else if(hello.jobHash != jobHash)
+						reason = "different scene or settings";
+					if(!reason.empty())
+					{
+						sendMessage(connection.fd, MSG_REJECT, reason.data(), reason.size());
+						drop(connection, "turned away: " + reason);
+						break;
+					}
+					connection.greeted = true;
+					stats.workers++;
+					log("Worker " + std::to_string(connection.id) + " joined");
+				}
+				else if(header.type == MSG_TILE)
+				{
+					if(header.size < sizeof(value) || value < 0 || value >= numTiles ||
+					   !decompressTile(payload + sizeof(value), header.size - sizeof(value), words.data()))
+					{
+						drop(connection, "sent a corrupt tile");
+						break;
+					}
+					framebuffer.setTile(value, words.data());
+					stats.tiles++;
+					stats.rawBytes += TILE_BYTES;
+					stats.compressedBytes += header.size - sizeof(value);
+					if(!received[value])
+					{
+						received[value] = true;
+						tilesLeft--;
+					}
+				}
+				else if(header.type == MSG_JOB_DONE)
+				{
+					if(connection.jobs.empty() || connection.jobs.front().first != value)
+					{
+						drop(connection, "finished a job it was not given");
+						break;
+					}
+					connection.jobs.pop_front();
+					stats.jobs++;
+				}
+				else if(header.type != MSG_PROGRESS)
+				{
+					drop(connection, "sent a corrupt message");
+					break;
+				}
+			}
+			if(connection.fd >= 0)
+				connection.input.erase(connection.input.begin(), connection.input.begin() + used);
+		}
+
+		for(; nextReport < 10 && (numTiles - tilesLeft) * 10 >= nextReport * numTiles; nextReport++)
+			log(std::to_string(nextReport * 10) + "% of tiles composited");
+
+		// Workers that have jobs, or have not said hello yet, must be heard from regularly
+		for(std::size_t w = 0; w < connections.size(); w++)
+		{
+			WorkerConnection& connection = connections[w];
+			double silent = secondsBetween(connection.lastHeard, now);
+			if(connection.fd >= 0 && (!connection.greeted || !connection.jobs.empty()) && silent > stallTimeout)
+				drop(connection, "stalled for " + std::to_string(int(silent)) + " s");
+		}
+
+		// Accepted after polling, so the new connection's first poll is the next one
+		if(fds[0].revents & POLLIN)
+		{
+			int fd = accept(listener, NULL, NULL);
+			if(fd >= 0)
+			{
+				int one = 1;
+				setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // Fails harmlessly on Unix sockets
+				WorkerConnection connection;
+				connection.fd = fd;
+				connection.id = nextId++;
+				connection.greeted = false;
+				connection.lastHeard = now;
+				connections.push_back(connection);
+			}
+		}
+
+		for(std::size_t w = 0; w < connections.size(); w++)
+		{
+			WorkerConnection& connection = connections[w];
+			while(connection.fd >= 0 && connection.greeted && connection.jobs.size() < NET_JOBS_QUEUED && !pending.empty())
+			{
+				Job job = pending.front();
+				pending.pop_front();
+				if(isComplete(job))
+					continue;
+				int32_t payload[2] = {job.first, job.count};
+				if(!sendMessage(connection.fd, MSG_ASSIGN, payload, sizeof(payload)))
+				{
+					pending.push_front(job);
+					drop(connection, "disconnected");
+					break;
+				}
+				// A worker's silence only counts from when it has something to do
+				if(connection.jobs.empty())
+					connection.lastHeard = now;
+				connection.jobs.push_back(job);
+			}
+		}
+		connections.erase(std::remove_if(connections.begin(), connections.end(),
+		                                 [](const WorkerConnection& connection) {return connection.fd < 0;}),
+		                  connections.end());
+	}
+
+	for(std::size_t w = 0; w < connections.size(); w++)
+	{
+		if(tilesLeft == 0 && connections[w].greeted)
+			sendMessage(connections[w].fd, MSG_FINISH, NULL, 0);
+		close(connections[w].fd);
+	}
+	close(listener);
+	if(std::strncmp(address, "unix:", 5) == 0)
+		unlink(address + 5);
+	return tilesLeft == 0;
+}
+
+bool runWorker(const char *address, uint64_t jobHash, World *world, Camera *camera, const Sampler& sampler,
+               int samplesPerPixel, float noiseThreshold, int numThreads, NetRenderStats& stats, std::string& error)
+{
+	// The coordinator may still be starting up
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	int fd;
+	while((fd = openSocket(address, false, error)) < 0 &&
+	      secondsBetween(start, std::chrono::steady_clock::now()) < NET_CONNECT_SECONDS)
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	if(fd < 0)
+		return false;
+
+	NetHello hello;
+	std::memset(&hello, 0, sizeof(hello));
+	std::memcpy(hello.magic, NET_MAGIC, sizeof(hello.magic));
+	hello.byteOrder = NET_BYTE_ORDER;
+	hello.jobHash = jobHash;
+	bool ok = sendMessage(fd, MSG_HELLO, &hello, sizeof(hello));
+
+	const int width = camera->getWidth(), imageHeight = camera->getImageHeight();
+	const int tilesX = (width + FRAMEBUFFER_TILE_SIZE - 1) / FRAMEBUFFER_TILE_SIZE;
+	const int tilesY = (imageHeight + FRAMEBUFFER_TILE_SIZE - 1) / FRAMEBUFFER_TILE_SIZE;
+	std::vector<uint32_t> words(FRAMEBUFFER_TILE_WORDS);
+	std::vector<unsigned char> message;
+	uint32_t type;
+	while(ok && (ok = receiveMessage(fd, type, message)) && type != MSG_FINISH)
+	{
+		if(type == MSG_REJECT)
+		{
+			error = std::string(address) + " turned this worker away: " + std::string(message.begin(), message.end());
+			close(fd);
+			return false;
+		}
+		int32_t job[2] = {-1, 0};
+		if(type == MSG_ASSIGN && message.size() == sizeof(job))
+			std::memcpy(job, message.data(), sizeof(job));
+		int first = job[0], count = job[1];
+		if(first < 0 || first >= tilesX * tilesY || count <= 0 || first % tilesX + count > tilesX)
+		{
+			error = std::string("unexpected message from ") + address;
+			close(fd);
+			return false;
+		}
+
+		// The job's row of tiles is the camera's band, where it starts at tile first % tilesX
+		int firstRow = first / tilesX * FRAMEBUFFER_TILE_SIZE;
+		camera->setBand(imageHeight, firstRow, std::min(FRAMEBUFFER_TILE_SIZE, imageHeight - firstRow));
+		RenderEngine engine(world, camera, 1);
+		engine.setSampler(sampler.clone());
+		engine.setProgressive(samplesPerPixel);
+		if(noiseThreshold > 0.0f)
+			engine.setAdaptive(noiseThreshold, 4 * samplesPerPixel);
+		engine.setTileRange(first % tilesX, count);
+		while(ok && !engine.isDone())
+		{
+			engine.renderPass(numThreads);
+			int32_t passes = engine.getPass();
+			ok = sendMessage(fd, MSG_PROGRESS, &passes, sizeof(passes));
+		}
+
+		std::vector<unsigned char> payload;
+		for(int t = 0; t < count && ok; t++)
+		{
+			int32_t tile = first + t;
+			camera->getFrameBuffer()->getTile(first % tilesX + t, words.data());
+			payload.assign((unsigned char*)&tile, (unsigned char*)&tile + sizeof(tile));
+			compressTile(words.data(), payload);
+			ok = sendMessage(fd, MSG_TILE, payload.data(), payload.size());
+			stats.tiles++;
+			stats.rawBytes += TILE_BYTES;
+			stats.compressedBytes += payload.size() - sizeof(tile);
+		}
+		int32_t done = first;
+		ok = ok && sendMessage(fd, MSG_JOB_DONE, &done, sizeof(done));
+		if(ok)
+			stats.jobs++;
+	}
+	if(!ok)
+		error = std::string("lost the connection to ") + address;
+	close(fd);
+	return ok;
+}
@@ -0,0 +1,48 @@
+//netrender.h
+#ifndef _NETRENDER_H_
+#define _NETRENDER_H_
+
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include "camera.h"
+#include "framebuffer.h"
+#include "sampler.h"
+#include "world.h"
+
+// Distributed rendering. A coordinator hands out jobs, runs of up to jobTiles tiles along one row
+// of tiles, to worker processes over TCP or Unix domain sockets. Each worker loads the same scene,
+// renders a job's tiles to completion in a band of FRAMEBUFFER_TILE_SIZE rows and sends them back
+// losslessly compressed, and the coordinator copies them into its frame buffer.
+//
+// Workers report after every pass. The jobs of a worker that disconnects, or reports nothing for
+// stallTimeout seconds, go to the other workers; the stalled worker is disconnected. Tiles only
+// depend on the scene and settings, so a tile rendered twice is the same both times.
+//
+// Addresses are "unix:PATH" or "HOST:PORT"; a coordinator given ":PORT" listens on every interface.
+// jobHash identifies the scene and settings, and a worker with another hash is turned away.
+
+struct NetRenderStats
+{
+	int workers;      // Workers that joined (coordinator)
+	int reissuedJobs; // Jobs handed out again after their worker was lost (coordinator)
+	int jobs;         // Jobs completed
+	int tiles;        // Tiles transferred
+	long long rawBytes, compressedBytes; // Tile data before and after compression
+
+	NetRenderStats(): workers(0), reissuedJobs(0), jobs(0), tiles(0), rawBytes(0), compressedBytes(0) {}
+};
+
+// Composites every tile of framebuffer from workers, calling log with news about them. Returns
+// false and sets error if the address cannot be listened on.
+bool runCoordinator(const char *address, uint64_t jobHash, int jobTiles, double stallTimeout, FrameBuffer& framebuffer,
+                    NetRenderStats& stats, const std::function<void(const std::string&)>& log, std::string& error);
+
+// Renders jobs until the coordinator has all tiles. camera must hold a band of the image (see
+// Camera::setBand) and is moved to each job's row of tiles. Returns false and sets error if the
+// coordinator cannot be reached within a few seconds, turns the worker away or goes away before
+// the image is complete.
+bool runWorker(const char *address, uint64_t jobHash, World *world, Camera *camera, const Sampler& sampler,
+               int samplesPerPixel, float noiseThreshold, int numThreads, NetRenderStats& stats, std::string& error);
+
+#endif
@@ -0,0 +1,8 @@
+//object.cpp
+
+#include "primitives.h"
+
+bool Object::intersect(Ray& ray) const
+{
+    return intersectObject(this, ray);
+}
@@ -9,14 +9,25 @@
 
 class Object
 {
+public:
+    // Compact type tag used to dispatch intersections without RTTI or virtual calls
+    enum Type { SPHERE, TRIANGLE, TRANSFORMED_SURFACE, SPHERE_SET, MESH, COMPRESSED_MESH };
+
 protected:
     Material *material;
     Camera *camera;
     bool isSolid;
+    Type type;
+    int id; // Index in the world's object list
 public:
-    Object(Material *mat, Camera *c): material(mat), camera(c) {}
-    virtual bool intersect(Ray& ray) const = 0;
-    virtual Color shade(const Ray& ray) const
+    Object(Material *mat, Camera *c, Type t): material(mat), camera(c), type(t), id(-1) {}
+    Type getType() const { return type; }
+    const Material* getMaterial() const { return material; }
+    Material* getMaterial() { return material; }
+    int getId() const { return id; }
+    void setId(int i) { id = i; }
+    bool intersect(Ray& ray) const;
+    Color shade(const Ray& ray) const
     {
         return material->shade(ray, isSolid);
     }
@@ -0,0 +1,424 @@
+//objloader.cpp
+
+#include "objloader.h"
+#include "filepath.h"
+#include "mappedfile.h"
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+
+// Chunks are sized for load balance; small files still get one chunk per thread
+#define OBJ_CHUNK_BYTES (8 << 20)
+
+struct OBJMaterialChange
+{
+	std::size_t triangle; // First triangle of the chunk that uses the material
+	std::string name;
+};
+
+// Everything parsed from one chunk. Indices are 0-based and absolute, except the ones listed
+// in relative: those came from negative indices and are relative to the chunk's first vertex.
+struct OBJChunk
+{
+	const char *begin, *end;
+	std::vector<float> vertices;
+	std::vector<int> indices;
+	std::vector<std::size_t> relative;
+	std::vector<OBJMaterialChange> materialChanges;
+	std::vector<std::string> libraries;
+	std::string error;
+};
+
+static inline bool isBlank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline const char* skipBlanks(const char *p, const char *end)
+{
+	while(p < end && isBlank(*p))
+		p++;
+	return p;
+}
+
+static inline const char* lineEnd(const char *p, const char *end)
+{
+	const char *e = static_cast<const char*>(std::memchr(p, '\n', end - p));
+	return e ? e : end;
+}
+
+// Rest of the line without surrounding blanks
+static std::string restOfLine(const char *p, const char *end)
+{
+	p = skipBlanks(p, end);
+	while(end > p && isBlank(end[-1]))
+		end--;
+	return std::string(p, end);
+}
+
+static void parseChunk(OBJChunk& chunk)
+{
+	const char *p = chunk.begin;
+	while(p < chunk.end && chunk.error.empty())
+	{
+		const char *eol = lineEnd(p, chunk.end);
+		const char *q = skipBlanks(p, eol);
+		if(q + 1 < eol && q[0] == 'v' && isBlank(q[1]))
+		{
+			q += 2;
+			for(int a = 0; a < 3; a++)
+			{
+				float value;
+				q = skipBlanks(q, eol);
+				std::from_chars_result r = std::from_chars(q, eol, value);
+				if(r.ec != std::errc())
+				{
+					chunk.error = "malformed vertex";
+					break;
+				}
+				chunk.vertices.push_back(value);
+				q = r.ptr;
+			}
+		}
+		else if(q + 1 < eol && q[0] == 'f' && isBlank(q[1]))
+		{
+			// v, v/vt, v//vn or v/vt/vn; only the position index is used. Polygons of any size
+			// are triangulated as fans while they are read.
+			q += 2;
+			int count = 0, first = 0, previous = 0;
+			const long localVertices = (long)(chunk.vertices.size() / 3);
+			for(;;)
+			{
+				q = skipBlanks(q, eol);
+				if(q >= eol)
+					break;
+				int index;
+				std::from_chars_result r = std::from_chars(q, eol, index);
+				if(r.ec != std::errc() || index == 0)
+				{
+					chunk.error = "malformed face";
+					break;
+				}
+				if(count >= 2)
+				{
+					int corners[3] = {first, previous, index};
+					for(int c = 0; c < 3; c++)
+					{
+						if(corners[c] < 0)
+						{
+							chunk.relative.push_back(chunk.indices.size());
+							chunk.indices.push_back((int)(localVertices + corners[c]));
+						}
+						else
+							chunk.indices.push_back(corners[c] - 1);
+					}
+				}
+				if(count++ == 0)
+					first = index;
+				previous = index;
+				q = r.ptr;
+				while(q < eol && !isBlank(*q))
+					q++;
+			}
+		}
+		else if(eol - q > 7 && std::memcmp(q, "usemtl", 6) == 0 && isBlank(q[6]))
+		{
+			OBJMaterialChange change;
+			change.triangle = chunk.indices.size() / 3;
+			change.name = restOfLine(q + 7, eol);
+			chunk.materialChanges.push_back(change);
+		}
+		else if(eol - q > 7 && std::memcmp(q, "mtllib", 6) == 0 && isBlank(q[6]))
+		{
+			// One or more file names
+			q += 7;
+			for(;;)
+			{
+				q = skipBlanks(q, eol);
+				const char *w = q;
+				while(q < eol && !isBlank(*q))
+					q++;
+				if(q == w)
+					break;
+				chunk.libraries.push_back(std::string(w, q));
+			}
+		}
+		// Everything else (comments, vt, vn, g, o, s, l, p) is skipped
+		p = eol + 1;
+	}
+}
+
+static float maxComponent(const float *v)
+{
+	return std::max(v[0], std::max(v[1], v[2]));
+}
+
+// Reads the materials of an MTL library into names/materials, keeping names already present
+static void parseMaterialLibrary(const std::string& path, std::vector<std::string>& names, std::vector<SceneMaterial>& materials)
+{
+	FILE *file = std::fopen(path.c_str(), "r");
+	if(!file)
+		return; // A missing library only loses colours; faces fall back to the default material
+
+	struct Entry
+	{
+		SceneMaterial m;
+		float Ka[3], Ks[3];
+		bool hasKa, hasKs, hasNi;
+		float Ni;
+		int illum;
+	};
+	std::vector<std::string> entryNames;
+	std::vector<Entry> entries;
+
+	char line[1024];
+	while(std::fgets(line, sizeof(line), file))
+	{
+		char key[32];
+		int consumed = 0;
+		if(std::sscanf(line, " %31s%n", key, &consumed) != 1)
+			continue;
+		const char *args = line + consumed;
+		if(std::strcmp(key, "newmtl") == 0)
+		{
+			Entry e;
+			std::memset(&e, 0, sizeof(e));
+			e.m.color[0] = e.m.color[1] = e.m.color[2] = 0.8f;
+			e.m.n = 64;
+			entries.push_back(e);
+			entryNames.push_back(restOfLine(args, args + std::strcspn(args, "\r\n")));
+			continue;
+		}
+		if(entries.empty())
+			continue;
+		Entry& e = entries.back();
+		float v[3];
+		if(std::strcmp(key, "Kd") == 0 && std::sscanf(args, "%f %f %f", &v[0], &v[1], &v[2]) == 3)
+			std::memcpy(e.m.color, v, sizeof(v));
+		else if(std::strcmp(key, "Ka") == 0 && std::sscanf(args, "%f %f %f", &v[0], &v[1], &v[2]) == 3)
+		{
+			std::memcpy(e.Ka, v, sizeof(v));
+			e.hasKa = true;
+		}
+		else if(std::strcmp(key, "Ks") == 0 && std::sscanf(args, "%f %f %f", &v[0], &v[1], &v[2]) == 3)
+		{
+			std::memcpy(e.Ks, v, sizeof(v));
+			e.hasKs = true;
+		}
+		else if(std::strcmp(key, "Ns") == 0 && std::sscanf(args, "%f", &v[0]) == 1)
+			e.m.n = std::max(1, (int)v[0]);
+		else if(std::strcmp(key, "Ni") == 0 && std::sscanf(args, "%f", &v[0]) == 1)
+		{
+			e.Ni = v[0];
+			e.hasNi = true;
+		}
+		else if(std::strcmp(key, "d") == 0 && std::sscanf(args, "%f", &v[0]) == 1)
+			e.m.kt = 1.0f - v[0];
+		else if(std::strcmp(key, "Tr") == 0 && std::sscanf(args, "%f", &v[0]) == 1)
+			e.m.kt = v[0];
+		else if(std::strcmp(key, "illum") == 0)
+			std::sscanf(args, "%d", &e.illum);
+	}
+	std::fclose(file);
+
+	for(std::size_t k = 0; k < entries.size(); k++)
+	{
+		if(std::find(names.begin(), names.end(), entryNames[k]) != names.end())
+			continue;
+		Entry& e = entries[k];
+		e.m.ka = e.hasKa ? maxComponent(e.Ka) : 0.25f;
+		e.m.kd = 0.75f;
+		e.m.ks = e.hasKs ? maxComponent(e.Ks) : 0.5f;
+		e.m.kr = e.illum >= 3 ? e.m.ks : 0.0f;
+		e.m.eta = e.m.kt > 0.0f && e.hasNi ? e.Ni : 0.0f;
+		e.m.C = 0.0f;
+		names.push_back(entryNames[k]);
+		materials.push_back(e.m);
+	}
+}
+
+static int findMaterial(const SceneDescription& scene, const std::string& name)
+{
+	for(std::size_t k = 0; k < scene.materialNames.size(); k++)
+		if(scene.materialNames[k] == name)
+			return (int)k;
+	return -1;
+}
+
+// Index of the named material, adding a neutral grey one if nobody defines it
+static int materialIndex(SceneDescription& scene, const std::string& name)
+{
+	int index = findMaterial(scene, name);
+	if(index >= 0)
+		return index;
+	SceneMaterial m = {{0.8f, 0.8f, 0.8f}, 0.25f, 0.75f, 0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 64};
+	scene.materialNames.push_back(name);
+	scene.materials.push_back(m);
+	return (int)scene.materials.size() - 1;
+}
+
+bool importOBJ(const char *path, SceneDescription& scene, int transform, int numThreads, std::string& error)
+{
+	MappedFile file;
+	if(!file.open(path, error))
+		return false;
+	file.prefetch(0, file.getSize());
+
+	if(numThreads <= 0)
+		numThreads = defaultThreadCount();
+
+	// Split at line boundaries
+	const char *data = file.getData(), *end = data + file.getSize();
+	std::size_t numChunks = std::max<std::size_t>(numThreads, (file.getSize() + OBJ_CHUNK_BYTES - 1) / OBJ_CHUNK_BYTES);
+	std::vector<OBJChunk> chunks;
+	const char *p = data;
+	for(std::size_t c = 0; c < numChunks && p < end; c++)
+	{
+		const char *e = c + 1 == numChunks ? end : std::min(end, data + file.getSize() * (c + 1) / numChunks);
+		if(e < p)
+			e = p;
+		e = e < end ? lineEnd(e, end) : end;
+		if(e < end)
+			e++; // Include the newline
+		OBJChunk chunk;
+		chunk.begin = p;
+		chunk.end = e;
+		chunks.push_back(chunk);
+		p = e;
+	}
+
+	parallelFor(0, (int)chunks.size(), numThreads, [&](int begin, int finish) {
+		for(int c = begin; c < finish; c++)
+			parseChunk(chunks[c]);
+	});
+
+	for(std::size_t c = 0; c < chunks.size(); c++)
+		if(!chunks[c].error.empty())
+		{
+			// Lines are not counted while parsing in parallel; locate the error by its chunk
+			error = std::string(path) + ": " + chunks[c].error + " in bytes " + std::to_string(chunks[c].begin - data) +
+			        "-" + std::to_string(chunks[c].end - data);
+			return false;
+		}
+
+	// Material libraries, then the material of every run of triangles
+	std::string directory = directoryOf(path);
+	for(std::size_t c = 0; c < chunks.size(); c++)
+		for(std::size_t l = 0; l < chunks[c].libraries.size(); l++)
+			parseMaterialLibrary(directory + chunks[c].libraries[l], scene.materialNames, scene.materials);
+
+	// Runs of triangles per chunk with their material; a chunk starts with the previous chunk's material
+	struct Run
+	{
+		std::size_t begin, end;
+		int material;
+	};
+	std::vector<std::vector<Run> > runs(chunks.size());
+	std::vector<std::size_t> vertexBase(chunks.size() + 1, 0);
+	int current = -1;
+	for(std::size_t c = 0; c < chunks.size(); c++)
+	{
+		const OBJChunk& chunk = chunks[c];
+		std::size_t numTriangles = chunk.indices.size() / 3;
+		std::size_t start = 0;
+		for(std::size_t k = 0; k <= chunk.materialChanges.size(); k++)
+		{
+			std::size_t stop = k < chunk.materialChanges.size() ? chunk.materialChanges[k].triangle : numTriangles;
+			if(stop > start)
+			{
+				if(current < 0)
+					current = materialIndex(scene, "default");
+				Run run = {start, stop, current};
+				runs[c].push_back(run);
+			}
+			if(k < chunk.materialChanges.size())
+				current = materialIndex(scene, chunk.materialChanges[k].name);
+			start = stop;
+		}
+		vertexBase[c + 1] = vertexBase[c] + chunk.vertices.size() / 3;
+	}
+	const std::size_t numVertices = vertexBase[chunks.size()];
+
+	// Triangles per material, then where every run lands in the material-sorted index array
+	std::vector<std::size_t> materialTriangles(scene.materials.size(), 0);
+	for(std::size_t c = 0; c < chunks.size(); c++)
+		for(std::size_t r = 0; r < runs[c].size(); r++)
+			materialTriangles[runs[c][r].material] += runs[c][r].end - runs[c][r].begin;
+
+	const std::size_t firstVertex = scene.vertices.size() / 3;
+	const std::size_t firstIndex = scene.indices.size();
+	std::vector<std::size_t> materialStart(scene.materials.size(), 0);
+	std::size_t totalTriangles = 0;
+	for(std::size_t m = 0; m < materialTriangles.size(); m++)
+	{
+		materialStart[m] = totalTriangles;
+		if(materialTriangles[m] > 0)
+		{
+			SceneMesh mesh = {(int)m, transform, firstVertex, numVertices, firstIndex + totalTriangles * 3, materialTriangles[m]};
+			scene.meshes.push_back(mesh);
+		}
+		totalTriangles += materialTriangles[m];
+	}
+	std::vector<std::vector<std::size_t> > runTarget(chunks.size());
+	std::vector<std::size_t> cursor = materialStart;
+	for(std::size_t c = 0; c < chunks.size(); c++)
+		for(std::size_t r = 0; r < runs[c].size(); r++)
+		{
+			runTarget[c].push_back(cursor[runs[c][r].material]);
+			cursor[runs[c][r].material] += runs[c][r].end - runs[c][r].begin;
+		}
+
+	if(numVertices > (std::size_t)INT32_MAX)
+	{
+		error = std::string(path) + ": too many vertices";
+		return false;
+	}
+
+	scene.vertices.resize((firstVertex + numVertices) * 3);
+	scene.indices.resize(firstIndex + totalTriangles * 3);
+	float *vertices = scene.vertices.data() + firstVertex * 3;
+	int *indices = scene.indices.data() + firstIndex;
+
+	// Every chunk copies its vertices and scatters its triangles independently
+	std::atomic<bool> outOfRange(false);
+	parallelFor(0, (int)chunks.size(), numThreads, [&](int begin, int finish) {
+		for(int c = begin; c < finish; c++)
+		{
+			OBJChunk& chunk = chunks[c];
+			std::copy(chunk.vertices.begin(), chunk.vertices.end(), vertices + vertexBase[c] * 3);
+			for(std::size_t k = 0; k < chunk.relative.size(); k++)
+				chunk.indices[chunk.relative[k]] += (int)vertexBase[c];
+
+			for(std::size_t r = 0; r < runs[c].size(); r++)
+			{
+				const Run& run = runs[c][r];
+				int *target = indices + runTarget[c][r] * 3;
+				for(std::size_t k = run.begin * 3; k < run.end * 3; k++)
+				{
+					int index = chunk.indices[k];
+					if(index < 0 || (std::size_t)index >= numVertices)
+						outOfRange = true;
+					*target++ = index;
+				}
+			}
+			// Release the chunk's memory as soon as it has been merged
+			std::vector<float>().swap(chunk.vertices);
+			std::vector<int>().swap(chunk.indices);
+		}
+	});
+
+	if(outOfRange)
+	{
+		error = std::string(path) + ": face index out of range";
+		scene.vertices.resize(firstVertex * 3);
+		scene.indices.resize(firstIndex);
+		while(!scene.meshes.empty() && scene.meshes.back().firstIndex >= firstIndex && scene.meshes.back().firstVertex == firstVertex &&
+		      scene.meshes.back().numVertices == numVertices)
+			scene.meshes.pop_back();
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,23 @@
+//objloader.h
+#ifndef _OBJLOADER_H_
+#define _OBJLOADER_H_
+
+#include <string>
+#include "scenefile.h"
+
+// Wavefront OBJ importer. The file is memory mapped, split into chunks at line boundaries and
+// the chunks are parsed in parallel, then merged into one indexed float mesh per material.
+// Only positions and faces are read: texture coordinates, normals, groups, lines and points
+// are skipped, and polygons are triangulated as fans. Negative (relative) indices are supported.
+//
+// Materials come from the file's mtllib libraries and are mapped onto Material as:
+//   color = Kd, ka = max(Ka) (0.25 if absent), kd = 0.75, ks = max(Ks) (0.5 if absent),
+//   n = Ns (64 if absent), kt = 1 - d (or Tr), eta = Ni if the material is transparent,
+//   kr = max(Ks) for illum 3 and above (reflection on), C = 0.
+// A material the scene already defines under the same name is used instead, so a scene file
+// can override an asset's materials. Faces before any usemtl get a neutral grey "default".
+//
+// Appends the materials and meshes to the scene. transform is applied to the meshes (-1 for none).
+bool importOBJ(const char *path, SceneDescription& scene, int transform, int numThreads, std::string& error);
+
+#endif
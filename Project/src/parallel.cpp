@@ -0,0 +1,61 @@
+//parallel.cpp
+
+#include "parallel.h"
+#include <exception>
+#include <thread>
+#include <vector>
+
+int defaultThreadCount()
+{
+	unsigned int n = std::thread::hardware_concurrency();
+	return n ? (int)n : 1;
+}
+
+void parallelFor(int begin, int end, int numThreads, const std::function<void(int, int)>& body)
+{
+	if(end <= begin)
+		return;
+	if(numThreads <= 0)
+		numThreads = defaultThreadCount();
+	if(numThreads > end - begin)
+		numThreads = end - begin;
+	if(numThreads == 1)
+	{
+		body(begin, end);
+		return;
+	}
+
+	// The calling thread takes the first chunk itself. An exception (typically std::bad_alloc)
+	// is passed on to the caller once every thread has finished, instead of terminating.
+	std::vector<std::thread> threads;
+	std::vector<std::exception_ptr> errors(numThreads);
+	int count = end - begin;
+	for(int t = 1; t < numThreads; t++)
+	{
+		int chunkBegin = begin + (int)((long long)count * t / numThreads);
+		int chunkEnd = begin + (int)((long long)count * (t + 1) / numThreads);
+		threads.push_back(std::thread([&body, &errors, t, chunkBegin, chunkEnd]() {
+			try
+			{
+				body(chunkBegin, chunkEnd);
+			}
+			catch(...)
+			{
+				errors[t] = std::current_exception();
+			}
+		}));
+	}
+	try
+	{
+		body(begin, begin + count / numThreads);
+	}
+	catch(...)
+	{
+		errors[0] = std::current_exception();
+	}
+	for(std::thread& thread : threads)
+		thread.join();
+	for(std::size_t t = 0; t < errors.size(); t++)
+		if(errors[t])
+			std::rethrow_exception(errors[t]);
+}
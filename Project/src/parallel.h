@@ -0,0 +1,15 @@
+//parallel.h
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include <functional>
+
+// Number of worker threads to use when the caller asks for 0 (all hardware threads)
+int defaultThreadCount();
+
+// Split [begin, end) into contiguous chunks and run body(chunkBegin, chunkEnd) on up to
+// numThreads threads. numThreads <= 0 uses every hardware thread. Returns when all chunks are done,
+// rethrowing an exception thrown by any of them.
+void parallelFor(int begin, int end, int numThreads, const std::function<void(int, int)>& body);
+
+#endif
@@ -0,0 +1,517 @@
+//plyloader.cpp
+
+#include "plyloader.h"
+#include <algorithm>
+#include <cstring>
+#include <float.h>
+#include <limits.h>
+#include <sstream>
+
+enum PLYType {PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64, PLY_INVALID};
+
+static const char *plyTypeNames[][2] = {
+	{"char", "int8"}, {"uchar", "uint8"}, {"short", "int16"}, {"ushort", "uint16"},
+	{"int", "int32"}, {"uint", "uint32"}, {"float", "float32"}, {"double", "float64"}
+};
+static const std::size_t plyTypeSizes[] = {1, 1, 2, 2, 4, 4, 4, 8};
+
+struct PLYProperty
+{
+	std::string name;
+	PLYType type;      // Item type for a list
+	PLYType countType; // PLY_INVALID unless a list
+};
+
+struct PLYElement
+{
+	std::string name;
+	std::size_t count;
+	std::vector<PLYProperty> properties;
+	std::size_t offset; // Of the element's data in the file, filled in by locateElements
+
+	// Size of every record, or 0 if the element has list properties
+	std::size_t recordSize() const
+	{
+		std::size_t size = 0;
+		for(std::size_t k = 0; k < properties.size(); k++)
+		{
+			if(properties[k].countType != PLY_INVALID)
+				return 0;
+			size += plyTypeSizes[properties[k].type];
+		}
+		return size;
+	}
+};
+
+static PLYType parseType(const std::string& name)
+{
+	for(int t = 0; t < PLY_INVALID; t++)
+		if(name == plyTypeNames[t][0] || name == plyTypeNames[t][1])
+			return PLYType(t);
+	return PLY_INVALID;
+}
+
+// Values are little endian like the host (checked in readHeader), read with memcpy since
+// records are packed without alignment
+static double readValue(const char *p, PLYType type)
+{
+	switch(type)
+	{
+		case PLY_INT8: {signed char v; std::memcpy(&v, p, 1); return v;}
+		case PLY_UINT8: {unsigned char v; std::memcpy(&v, p, 1); return v;}
+		case PLY_INT16: {short v; std::memcpy(&v, p, 2); return v;}
+		case PLY_UINT16: {unsigned short v; std::memcpy(&v, p, 2); return v;}
+		case PLY_INT32: {int v; std::memcpy(&v, p, 4); return v;}
+		case PLY_UINT32: {unsigned v; std::memcpy(&v, p, 4); return v;}
+		case PLY_FLOAT32: {float v; std::memcpy(&v, p, 4); return v;}
+		default: {double v; std::memcpy(&v, p, 8); return v;}
+	}
+}
+
+static long long readInteger(const char *p, PLYType type)
+{
+	if(type == PLY_INT32)
+	{
+		int v;
+		std::memcpy(&v, p, 4);
+		return v;
+	}
+	return (long long)readValue(p, type);
+}
+
+// Returns the end of the record at p, or NULL if it runs past end
+static const char* skipRecord(const PLYElement& element, const char *p, const char *end)
+{
+	for(std::size_t k = 0; k < element.properties.size(); k++)
+	{
+		const PLYProperty& prop = element.properties[k];
+		if(prop.countType == PLY_INVALID)
+			p += plyTypeSizes[prop.type];
+		else
+		{
+			if(p + plyTypeSizes[prop.countType] > end)
+				return NULL;
+			long long n = readInteger(p, prop.countType);
+			if(n < 0)
+				return NULL;
+			p += plyTypeSizes[prop.countType];
+			if((std::size_t)n > (std::size_t)(end - p) / plyTypeSizes[prop.type])
+				return NULL;
+			p += n * plyTypeSizes[prop.type];
+		}
+		if(p > end)
+			return NULL;
+	}
+	return p;
+}
+
+struct PLYFile
+{
+	MappedFile file;
+	std::vector<PLYElement> elements;
+	int vertexElement, faceElement;
+	int x, y, z;     // Vertex properties
+	int faceIndices; // Face property
+
+	bool fail(const char *path, const std::string& message, std::string& error) const
+	{
+		error = std::string(path) + ": " + message;
+		return false;
+	}
+
+	bool readHeader(const char *path, std::string& error)
+	{
+		const char *data = file.getData(), *end = data + file.getSize();
+		const char *p = data;
+		std::size_t headerEnd = 0;
+		bool binaryLittleEndian = false;
+		vertexElement = faceElement = -1;
+		if(file.getSize() < 4 || std::memcmp(data, "ply", 3) != 0 || (data[3] != '\n' && data[3] != '\r'))
+			return fail(path, "not a PLY file", error);
+		while(p < end && headerEnd == 0)
+		{
+			const char *eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+			if(!eol)
+				return fail(path, "unterminated header", error);
+			std::istringstream line(std::string(p, eol));
+			p = eol + 1;
+			std::string keyword;
+			line >> keyword;
+			if(keyword == "format")
+			{
+				std::string format;
+				line >> format;
+				binaryLittleEndian = format == "binary_little_endian";
+			}
+			else if(keyword == "element")
+			{
+				PLYElement element;
+				line >> element.name >> element.count;
+				if(!line)
+					return fail(path, "malformed element", error);
+				element.offset = 0;
+				elements.push_back(element);
+			}
+			else if(keyword == "property")
+			{
+				if(elements.empty())
+					return fail(path, "property outside an element", error);
+				PLYProperty prop;
+				std::string type;
+				line >> type;
+				prop.countType = PLY_INVALID;
+				if(type == "list")
+				{
+					std::string countType;
+					line >> countType >> type;
+					prop.countType = parseType(countType);
+					if(prop.countType == PLY_INVALID || prop.countType == PLY_FLOAT32 || prop.countType == PLY_FLOAT64)
+						return fail(path, "invalid list count type '" + countType + "'", error);
+				}
+				prop.type = parseType(type);
+				line >> prop.name;
+				if(prop.type == PLY_INVALID || !line)
+					return fail(path, "invalid property type '" + type + "'", error);
+				elements.back().properties.push_back(prop);
+			}
+			else if(keyword == "end_header")
+				headerEnd = p - data;
+			// comment and obj_info lines are ignored
+		}
+		if(headerEnd == 0)
+			return fail(path, "unterminated header", error);
+
+		const unsigned probe = 1;
+		char firstByte;
+		std::memcpy(&firstByte, &probe, 1);
+		if(!binaryLittleEndian || firstByte != 1)
+			return fail(path, "only binary little-endian PLY files are supported", error);
+
+		for(std::size_t e = 0; e < elements.size(); e++)
+		{
+			if(elements[e].name == "vertex" && vertexElement < 0)
+				vertexElement = (int)e;
+			if(elements[e].name == "face" && faceElement < 0)
+				faceElement = (int)e;
+		}
+		if(vertexElement < 0 || faceElement < 0)
+			return fail(path, "no vertex or face element", error);
+
+		const PLYElement& v = elements[vertexElement];
+		x = y = z = -1;
+		for(std::size_t k = 0; k < v.properties.size(); k++)
+		{
+			int *slot = v.properties[k].name == "x" ? &x : v.properties[k].name == "y" ? &y : v.properties[k].name == "z" ? &z : NULL;
+			if(slot && v.properties[k].countType == PLY_INVALID)
+				*slot = (int)k;
+		}
+		if(x < 0 || y < 0 || z < 0)
+			return fail(path, "vertices have no x, y and z", error);
+
+		const PLYElement& f = elements[faceElement];
+		faceIndices = -1;
+		for(std::size_t k = 0; k < f.properties.size(); k++)
+			if(f.properties[k].countType != PLY_INVALID && f.properties[k].type != PLY_FLOAT32 && f.properties[k].type != PLY_FLOAT64 &&
+			   (f.properties[k].name == "vertex_indices" || f.properties[k].name == "vertex_index"))
+				faceIndices = (int)k;
+		if(faceIndices < 0)
+			return fail(path, "faces have no vertex_indices list", error);
+
+		return locateElements(headerEnd, path, error);
+	}
+
+	// Finds where the vertex and face data start, walking variable-size elements in front of them
+	bool locateElements(std::size_t offset, const char *path, std::string& error)
+	{
+		const char *data = file.getData(), *end = data + file.getSize();
+		std::size_t last = std::max(vertexElement, faceElement);
+		for(std::size_t e = 0; e <= last; e++)
+		{
+			PLYElement& element = elements[e];
+			element.offset = offset;
+			if(e == last)
+				break;
+			std::size_t size = element.recordSize();
+			if(size > 0)
+			{
+				if(element.count > (file.getSize() - offset) / size)
+					return fail(path, "file is truncated", error);
+				offset += element.count * size;
+			}
+			else
+			{
+				const char *p = data + offset;
+				for(std::size_t k = 0; k < element.count && p; k++)
+					p = skipRecord(element, p, end);
+				if(!p)
+					return fail(path, "file is truncated", error);
+				offset = p - data;
+			}
+		}
+		// The last of the two is checked as it is read, except for vertices used in place
+		const PLYElement& v = elements[vertexElement];
+		std::size_t vertexSize = v.recordSize();
+		if(vertexElement == (int)last && vertexSize > 0 && v.count > (file.getSize() - v.offset) / vertexSize)
+			return fail(path, "file is truncated", error);
+		return true;
+	}
+
+	std::size_t propertyOffset(const PLYElement& element, int property) const
+	{
+		std::size_t offset = 0;
+		for(int k = 0; k < property; k++)
+			offset += plyTypeSizes[element.properties[k].type];
+		return offset;
+	}
+
+	// Positions are three consecutive floats in fixed-size records
+	bool verticesInPlace(std::size_t& xOffset, std::size_t& stride) const
+	{
+		const PLYElement& v = elements[vertexElement];
+		stride = v.recordSize();
+		if(stride == 0 || y != x + 1 || z != x + 2)
+			return false;
+		for(int k = x; k <= z; k++)
+			if(v.properties[k].type != PLY_FLOAT32)
+				return false;
+		xOffset = propertyOffset(v, x);
+		return true;
+	}
+
+	// Checks every face, and whether they are all triangles of 32-bit indices that can be used in place
+	bool checkFaces(bool& inPlace, std::size_t& indexOffset, std::size_t& stride, const char *path, std::string& error) const
+	{
+		const PLYElement& f = elements[faceElement];
+		const PLYElement& v = elements[vertexElement];
+		const PLYProperty& list = f.properties[faceIndices];
+		const char *data = file.getData();
+
+		inPlace = f.properties.size() == 1 && (list.type == PLY_INT32 || list.type == PLY_UINT32);
+		indexOffset = plyTypeSizes[list.countType];
+		stride = indexOffset + 3 * 4;
+		if(inPlace && f.count > (file.getSize() - f.offset) / stride)
+			inPlace = false;
+		if(inPlace)
+		{
+			const char *p = data + f.offset;
+			for(std::size_t t = 0; t < f.count; t++, p += stride)
+			{
+				if(readInteger(p, list.countType) != 3)
+				{
+					inPlace = false;
+					break;
+				}
+				int idx[3];
+				std::memcpy(idx, p + indexOffset, sizeof(idx));
+				if((unsigned)idx[0] >= v.count || (unsigned)idx[1] >= v.count || (unsigned)idx[2] >= v.count)
+					return fail(path, "face index out of range", error);
+			}
+		}
+		// Faces that are not used in place are checked by convert
+		return true;
+	}
+
+	// One streaming pass appending packed positions and fan-triangulated faces
+	bool convert(std::vector<float>& vertices, std::vector<int>& indices, const char *path, std::string& error) const
+	{
+		const char *data = file.getData(), *end = data + file.getSize();
+		const PLYElement& v = elements[vertexElement];
+		const PLYElement& f = elements[faceElement];
+
+		std::size_t firstVertex = vertices.size();
+		vertices.reserve(firstVertex + v.count * 3);
+		const int axes[3] = {x, y, z};
+		std::size_t offsets[3];
+		for(int a = 0; a < 3; a++)
+			offsets[a] = propertyOffset(v, axes[a]);
+		const char *p = data + v.offset;
+		std::size_t vertexSize = v.recordSize();
+		for(std::size_t k = 0; k < v.count; k++)
+		{
+			const char *next = vertexSize > 0 ? p + vertexSize : skipRecord(v, p, end);
+			if(!next || next > end)
+				return fail(path, "file is truncated", error);
+			for(int a = 0; a < 3; a++)
+			{
+				// With lists in the record, only the properties before the first list have fixed offsets
+				const char *value = p + offsets[a];
+				if(vertexSize == 0)
+				{
+					value = p;
+					for(int q = 0; q < axes[a]; q++)
+						value = v.properties[q].countType == PLY_INVALID ? value + plyTypeSizes[v.properties[q].type] :
+						        value + plyTypeSizes[v.properties[q].countType] +
+						        readInteger(value, v.properties[q].countType) * plyTypeSizes[v.properties[q].type];
+				}
+				vertices.push_back((float)readValue(value, v.properties[axes[a]].type));
+			}
+			p = next;
+		}
+
+		const PLYProperty& list = f.properties[faceIndices];
+		std::size_t itemSize = plyTypeSizes[list.type];
+		indices.reserve(indices.size() + f.count * 3);
+		p = data + f.offset;
+		for(std::size_t t = 0; t < f.count; t++)
+		{
+			const char *next = skipRecord(f, p, end);
+			if(!next)
+				return fail(path, "file is truncated", error);
+			const char *q = p;
+			for(int k = 0; k < faceIndices; k++)
+				q = f.properties[k].countType == PLY_INVALID ? q + plyTypeSizes[f.properties[k].type] :
+				    q + plyTypeSizes[f.properties[k].countType] + readInteger(q, f.properties[k].countType) * plyTypeSizes[f.properties[k].type];
+			long long n = readInteger(q, list.countType);
+			q += plyTypeSizes[list.countType];
+			for(long long c = 0; c < n; c++)
+			{
+				long long idx = readInteger(q + c * itemSize, list.type);
+				if(idx < 0 || (std::size_t)idx >= v.count)
+					return fail(path, "face index out of range", error);
+				if(c >= 2)
+				{
+					indices.push_back((int)readInteger(q, list.type));
+					indices.push_back((int)readInteger(q + (c - 1) * itemSize, list.type));
+					indices.push_back((int)idx);
+				}
+			}
+			p = next;
+		}
+		return true;
+	}
+
+	bool open(const char *path, std::string& error)
+	{
+		if(!file.open(path, error))
+			return false;
+		if(!readHeader(path, error))
+			return false;
+		if(elements[vertexElement].count > (std::size_t)INT_MAX)
+			return fail(path, "too many vertices", error);
+		return true;
+	}
+};
+
+bool PLYMesh::open(const char *path, std::string& error)
+{
+	PLYFile ply;
+	if(!ply.open(path, error))
+		return false;
+	ply.file.prefetch(0, ply.file.getSize());
+
+	const PLYElement& v = ply.elements[ply.vertexElement];
+	const PLYElement& f = ply.elements[ply.faceElement];
+	std::size_t xOffset, stride, indexOffset, faceStride;
+	bool facesInPlace;
+	if(!ply.checkFaces(facesInPlace, indexOffset, faceStride, path, error))
+		return false;
+
+	// The BVH needs at least one triangle; a mesh without any has nothing to render either
+	if(f.count == 0)
+	{
+		error = std::string(path) + ": the mesh has no faces";
+		return false;
+	}
+	numVertices = v.count;
+	if(facesInPlace && ply.verticesInPlace(xOffset, stride))
+	{
+		// Keep the mapping: the mesh reads the file's records directly
+		mapped = true;
+		numTriangles = f.count;
+		vertexData = ply.file.getData() + v.offset + xOffset;
+		vertexStride = stride;
+		indexData = ply.file.getData() + f.offset + indexOffset;
+		indexStride = faceStride;
+		file.swap(ply.file);
+		return true;
+	}
+
+	mapped = false;
+	if(!ply.convert(vertices, indices, path, error))
+		return false;
+	numTriangles = indices.size() / 3;
+	if(numTriangles == 0)
+	{
+		error = std::string(path) + ": the mesh has no triangles";
+		return false;
+	}
+	vertexData = (const char*)vertices.data();
+	vertexStride = 3 * sizeof(float);
+	indexData = (const char*)indices.data();
+	indexStride = 3 * sizeof(int);
+	return true;
+}
+
+void PLYMesh::getBounds(float min[3], float max[3]) const
+{
+	min[0] = min[1] = min[2] = FLT_MAX;
+	max[0] = max[1] = max[2] = -FLT_MAX;
+	for(std::size_t k = 0; k < numVertices; k++)
+	{
+		float p[3];
+		std::memcpy(p, vertexData + k * vertexStride, sizeof(p));
+		for(int a = 0; a < 3; a++)
+		{
+			min[a] = std::min(min[a], p[a]);
+			max[a] = std::max(max[a], p[a]);
+		}
+	}
+}
+
+TriangleMesh* PLYMesh::createMesh(Material *material, Camera *camera)
+{
+	// Boxes are read from the mesh as the build needs them, so besides the nodes it only
+	// allocates order, which a mapped mesh keeps anyway
+	buildBVH(numTriangles, [this](unsigned t, float *min, float *max) {
+		int idx[3];
+		std::memcpy(idx, indexData + t * indexStride, sizeof(idx));
+		min[0] = min[1] = min[2] = FLT_MAX;
+		max[0] = max[1] = max[2] = -FLT_MAX;
+		for(int c = 0; c < 3; c++)
+		{
+			float p[3];
+			std::memcpy(p, vertexData + idx[c] * vertexStride, sizeof(p));
+			for(int a = 0; a < 3; a++)
+			{
+				min[a] = std::min(min[a], p[a]);
+				max[a] = std::max(max[a], p[a]);
+			}
+		}
+	}, nodes, order);
+
+	if(!mapped)
+	{
+		// Converted triangles are ours to reorder, which saves the indirection
+		std::vector<int> sorted(indices.size());
+		for(std::size_t t = 0; t < numTriangles; t++)
+			for(int c = 0; c < 3; c++)
+				sorted[t*3 + c] = indices[order[t]*3 + c];
+		indices.swap(sorted);
+		indexData = (const char*)indices.data();
+		order = std::vector<unsigned>();
+	}
+	return new TriangleMesh(numVertices, vertexData, vertexStride, numTriangles, indexData, indexStride,
+	                        order.empty() ? NULL : order.data(), nodes.data(), nodes.size(), material, camera);
+}
+
+bool importPLY(const char *path, SceneDescription& scene, int material, int transform, std::string& error)
+{
+	PLYFile ply;
+	if(!ply.open(path, error))
+		return false;
+	SceneMesh mesh;
+	mesh.material = material;
+	mesh.transform = transform;
+	mesh.firstVertex = scene.vertices.size() / 3;
+	mesh.firstIndex = scene.indices.size();
+	if(!ply.convert(scene.vertices, scene.indices, path, error))
+	{
+		scene.vertices.resize(mesh.firstVertex * 3);
+		scene.indices.resize(mesh.firstIndex);
+		return false;
+	}
+	mesh.numVertices = scene.vertices.size() / 3 - mesh.firstVertex;
+	mesh.numTriangles = (scene.indices.size() - mesh.firstIndex) / 3;
+	scene.meshes.push_back(mesh);
+	return true;
+}
@@ -0,0 +1,55 @@
+//plyloader.h
+#ifndef _PLYLOADER_H_
+#define _PLYLOADER_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "mappedfile.h"
+#include "scenefile.h"
+#include "trianglemesh.h"
+
+// Binary little-endian PLY triangle mesh. Only the positions (x, y, z) of the vertex element
+// and the index list of the face element are used; other properties and elements are skipped.
+//
+// When the positions are three consecutive floats, every face is a triangle and its indices are
+// 32-bit, the mesh is used straight from the mapped file: only the BVH and its leaf order are
+// allocated. Any other layout is converted to packed arrays in one streaming pass, with
+// polygons triangulated as fans.
+class PLYMesh
+{
+private:
+	MappedFile file;
+	std::size_t numVertices, numTriangles;
+	const char *vertexData, *indexData; // Into the mapping, or the converted arrays below
+	std::size_t vertexStride, indexStride;
+	std::vector<float> vertices;
+	std::vector<int> indices;
+	std::vector<unsigned> order;
+	std::vector<BVHNode> nodes;
+	bool mapped;
+
+	PLYMesh(const PLYMesh&);
+	PLYMesh& operator=(const PLYMesh&);
+
+public:
+	PLYMesh(): numVertices(0), numTriangles(0), vertexData(NULL), indexData(NULL), vertexStride(0), indexStride(0), mapped(false) {}
+
+	// Maps the file, validates every index and either uses the data in place or converts it.
+	// Returns false and sets error on failure, including for a mesh without triangles.
+	bool open(const char *path, std::string& error);
+
+	bool isMapped() const {return mapped;}
+	std::size_t getNumVertices() const {return numVertices;}
+	std::size_t getNumTriangles() const {return numTriangles;}
+	void getBounds(float min[3], float max[3]) const;
+
+	// Builds the BVH and the mesh object, which refers to this PLYMesh for its lifetime
+	TriangleMesh* createMesh(Material *material, Camera *camera);
+};
+
+// Appends the mesh to a scene description (always converted, since the scene keeps its own
+// arrays) with the given material and transform (-1 for none)
+bool importPLY(const char *path, SceneDescription& scene, int material, int transform, std::string& error);
+
+#endif
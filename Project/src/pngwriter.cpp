@@ -0,0 +1,379 @@
+//pngwriter.cpp
+
+#include "pngwriter.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <vector>
+
+#define DEFLATE_WINDOW 32768
+#define DEFLATE_HASH_BITS 15
+#define DEFLATE_MAX_CHAIN 32 // Candidates tried per position: speed over the last few percent of size
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+#define ADLER_BASE 65521u
+
+static const int lengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99,
+                                   115, 131, 163, 195, 227, 258};
+static const int lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const int distanceBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025,
+                                     1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const int distanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12,
+                                      12, 13, 13};
+
+// Deflate packs values starting from the least significant bit, Huffman codes from their most
+// significant bit
+struct BitWriter
+{
+	std::vector<unsigned char>& out;
+	uint32_t bits;
+	int count;
+
+	BitWriter(std::vector<unsigned char>& o): out(o), bits(0), count(0) {}
+
+	void put(uint32_t value, int n)
+	{
+		bits |= value << count;
+		count += n;
+		while(count >= 8)
+		{
+			out.push_back((unsigned char)bits);
+			bits >>= 8;
+			count -= 8;
+		}
+	}
+
+	void putCode(uint32_t code, int n)
+	{
+		uint32_t reversed = 0;
+		for(int k = 0; k < n; k++)
+			reversed |= ((code >> k) & 1) << (n - 1 - k);
+		put(reversed, n);
+	}
+
+	void align()
+	{
+		if(count > 0)
+			put(0, 8 - count);
+	}
+};
+
+// Literal/length symbol in the fixed Huffman code
+static inline void putSymbol(BitWriter& w, int s)
+{
+	if(s < 144)
+		w.putCode(0x30 + s, 8);
+	else if(s < 256)
+		w.putCode(0x190 + s - 144, 9);
+	else if(s < 280)
+		w.putCode(s - 256, 7);
+	else
+		w.putCode(0xC0 + s - 280, 8);
+}
+
+static inline void putMatch(BitWriter& w, int length, int distance)
+{
+	int l = 28;
+	while(lengthBase[l] > length)
+		l--;
+	putSymbol(w, 257 + l);
+	if(lengthExtra[l])
+		w.put(length - lengthBase[l], lengthExtra[l]);
+
+	int d = 29;
+	while(distanceBase[d] > distance)
+		d--;
+	w.putCode(d, 5);
+	if(distanceExtra[d])
+		w.put(distance - distanceBase[d], distanceExtra[d]);
+}
+
+static inline uint32_t hash3(const unsigned char *p)
+{
+	return ((uint32_t(p[0]) << 16 | uint32_t(p[1]) << 8 | p[2]) * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+}
+
+// One fixed Huffman block over data with greedy LZ77 matching. Unless final, the block is
+// followed by an empty stored block, which leaves the output on a byte boundary where the next
+// band's blocks can follow.
+static void deflateBand(const unsigned char *data, std::size_t n, bool final, std::vector<unsigned char>& out)
+{
+	std::vector<int> head(std::size_t(1) << DEFLATE_HASH_BITS, -1);
+	std::vector<int> prev(n);
+	BitWriter w(out);
+	w.put(final ? 1 : 0, 1);
+	w.put(1, 2);
+
+	std::size_t i = 0;
+	while(i < n)
+	{
+		int bestLength = 0, bestDistance = 0;
+		if(i + DEFLATE_MIN_MATCH <= n)
+		{
+			int maxLength = (int)std::min<std::size_t>(DEFLATE_MAX_MATCH, n - i);
+			int candidate = head[hash3(data + i)];
+			for(int chain = 0; candidate >= 0 && i - candidate <= DEFLATE_WINDOW && chain < DEFLATE_MAX_CHAIN; chain++)
+			{
+				const unsigned char *a = data + candidate, *b = data + i;
+				if(a[bestLength] == b[bestLength])
+				{
+					int length = 0;
+					while(length < maxLength && a[length] == b[length])
+						length++;
+					if(length > bestLength)
+					{
+						bestLength = length;
+						bestDistance = int(i - candidate);
+						if(length == maxLength)
+							break;
+					}
+				}
+				candidate = prev[candidate];
+			}
+		}
+
+		std::size_t next = i + (bestLength >= DEFLATE_MIN_MATCH ? bestLength : 1);
+		if(bestLength >= DEFLATE_MIN_MATCH)
+			putMatch(w, bestLength, bestDistance);
+		else
+			putSymbol(w, data[i]);
+		for(; i < next; i++)
+			if(i + DEFLATE_MIN_MATCH <= n)
+			{
+				uint32_t h = hash3(data + i);
+				prev[i] = head[h];
+				head[h] = (int)i;
+			}
+	}
+	putSymbol(w, 256);
+
+	if(!final)
+	{
+		w.put(0, 3);
+		w.align();
+		w.put(0x0000, 16);
+		w.put(0xFFFF, 16);
+	}
+	w.align();
+}
+
+static uint32_t crc32(uint32_t crc, const unsigned char *data, std::size_t n)
+{
+	struct Table
+	{
+		uint32_t entries[256];
+		Table()
+		{
+			for(uint32_t k = 0; k < 256; k++)
+			{
+				uint32_t c = k;
+				for(int bit = 0; bit < 8; bit++)
+					c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				entries[k] = c;
+			}
+		}
+	};
+	static const Table table;
+	crc = ~crc;
+	for(std::size_t k = 0; k < n; k++)
+		crc = table.entries[(crc ^ data[k]) & 255] ^ (crc >> 8);
+	return ~crc;
+}
+
+static uint32_t adler32(const unsigned char *data, std::size_t n)
+{
+	uint32_t a = 1, b = 0;
+	while(n > 0)
+	{
+		// 5552 bytes is the most that can be summed before b may overflow
+		std::size_t block = std::min<std::size_t>(n, 5552);
+		for(std::size_t k = 0; k < block; k++)
+		{
+			a += data[k];
+			b += a;
+		}
+		a %= ADLER_BASE;
+		b %= ADLER_BASE;
+		data += block;
+		n -= block;
+	}
+	return b << 16 | a;
+}
+
+// Checksum of two byte strings one after the other, from their own checksums
+static uint32_t adler32Combine(uint32_t first, uint32_t second, std::size_t secondLength)
+{
+	uint32_t remainder = uint32_t(secondLength % ADLER_BASE);
+	uint32_t a = first & 0xFFFF;
+	uint32_t b = uint32_t((uint64_t(remainder) * a) % ADLER_BASE);
+	a += (second & 0xFFFF) + ADLER_BASE - 1;
+	b += (first >> 16) + (second >> 16) + ADLER_BASE - remainder;
+	if(a >= ADLER_BASE)
+		a -= ADLER_BASE;
+	if(a >= ADLER_BASE)
+		a -= ADLER_BASE;
+	if(b >= 2 * ADLER_BASE)
+		b -= 2 * ADLER_BASE;
+	if(b >= ADLER_BASE)
+		b -= ADLER_BASE;
+	return b << 16 | a;
+}
+
+static inline void appendBE32(std::vector<unsigned char>& v, uint32_t x)
+{
+	v.push_back((unsigned char)(x >> 24));
+	v.push_back((unsigned char)(x >> 16));
+	v.push_back((unsigned char)(x >> 8));
+	v.push_back((unsigned char)x);
+}
+
+static inline int paeth(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+	if(pa <= pb && pa <= pc)
+		return a;
+	return pb <= pc ? b : c;
+}
+
+static inline unsigned char filterByte(int type, const unsigned char *row, const unsigned char *above, int k, int bpp)
+{
+	int a = k >= bpp ? row[k - bpp] : 0;
+	int b = above ? above[k] : 0;
+	int c = above && k >= bpp ? above[k - bpp] : 0;
+	switch(type)
+	{
+		case 0: return row[k];
+		case 1: return (unsigned char)(row[k] - a);
+		case 2: return (unsigned char)(row[k] - b);
+		case 3: return (unsigned char)(row[k] - ((a + b) >> 1));
+		default: return (unsigned char)(row[k] - paeth(a, b, c));
+	}
+}
+
+// Writes the filter type byte and the filtered row. Of the five filters, the one whose output has
+// the smallest sum of absolute signed values is kept, the usual guess at what deflates best.
+static void filterRow(const unsigned char *row, const unsigned char *above, int rowBytes, int bpp, unsigned char *out)
+{
+	int best = 0;
+	long bestCost = -1;
+	for(int type = 0; type < 5; type++)
+	{
+		long cost = 0;
+		for(int k = 0; k < rowBytes; k++)
+			cost += std::abs((int)(signed char)filterByte(type, row, above, k, bpp));
+		if(bestCost < 0 || cost < bestCost)
+		{
+			best = type;
+			bestCost = cost;
+		}
+	}
+	out[0] = (unsigned char)best;
+	for(int k = 0; k < rowBytes; k++)
+		out[k + 1] = filterByte(best, row, above, k, bpp);
+}
+
+bool writePNG(const char *path, int width, int height, int channels, const unsigned char *pixels, bool bottomUp,
+              int numThreads, std::string& error, std::atomic<int> *rowsDone)
+{
+	if(width <= 0 || height <= 0 || (channels != 3 && channels != 4))
+	{
+		error = std::string("cannot write ") + path + ": not an 8-bit RGB or RGBA image";
+		return false;
+	}
+	const std::size_t rowBytes = std::size_t(width) * channels;
+	const int bandRows = (int)std::max<std::size_t>(1, PNG_BAND_BYTES / (rowBytes + 1));
+	const int numBands = (height + bandRows - 1) / bandRows;
+
+	// Each band becomes an IDAT chunk: type, zlib data, and unless it is the last, its CRC
+	std::vector<std::vector<unsigned char> > chunks(numBands);
+	std::vector<uint32_t> adlers(numBands);
+	parallelFor(0, numBands, numThreads, [&](int first, int last) {
+		std::vector<unsigned char> filtered;
+		for(int band = first; band < last; band++)
+		{
+			int y0 = band * bandRows, y1 = std::min(height, y0 + bandRows);
+			filtered.resize(std::size_t(y1 - y0) * (rowBytes + 1));
+			for(int y = y0; y < y1; y++)
+			{
+				const unsigned char *row = pixels + std::size_t(bottomUp ? height - 1 - y : y) * rowBytes;
+				const unsigned char *above = y == 0 ? NULL : row + (bottomUp ? rowBytes : -(std::ptrdiff_t)rowBytes);
+				filterRow(row, above, (int)rowBytes, channels, &filtered[std::size_t(y - y0) * (rowBytes + 1)]);
+			}
+			adlers[band] = adler32(filtered.data(), filtered.size());
+
+			std::vector<unsigned char>& chunk = chunks[band];
+			chunk.reserve(filtered.size() / 2);
+			chunk.push_back('I');
+			chunk.push_back('D');
+			chunk.push_back('A');
+			chunk.push_back('T');
+			if(band == 0)
+			{
+				chunk.push_back(0x78); // Deflate with a 32K window
+				chunk.push_back(0x01); // No preset dictionary; check bits
+			}
+			deflateBand(filtered.data(), filtered.size(), band == numBands - 1, chunk);
+			if(band != numBands - 1)
+				appendBE32(chunk, crc32(0, chunk.data(), chunk.size()));
+			if(rowsDone)
+				rowsDone->fetch_add(y1 - y0);
+		}
+	});
+
+	// The zlib stream ends with the checksum of all bands' filtered bytes
+	uint32_t adler = adlers[0];
+	for(int band = 1; band < numBands; band++)
+	{
+		int rows = std::min(height, (band + 1) * bandRows) - band * bandRows;
+		adler = adler32Combine(adler, adlers[band], std::size_t(rows) * (rowBytes + 1));
+	}
+	std::vector<unsigned char>& lastChunk = chunks[numBands - 1];
+	appendBE32(lastChunk, adler);
+	appendBE32(lastChunk, crc32(0, lastChunk.data(), lastChunk.size()));
+
+	std::vector<unsigned char> header;
+	static const unsigned char signature[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+	header.insert(header.end(), signature, signature + 8);
+	appendBE32(header, 13);
+	std::size_t typeOffset = header.size();
+	header.push_back('I');
+	header.push_back('H');
+	header.push_back('D');
+	header.push_back('R');
+	appendBE32(header, width);
+	appendBE32(header, height);
+	header.push_back(8);                    // Bits per channel
+	header.push_back(channels == 4 ? 6 : 2); // RGBA or RGB
+	header.push_back(0);                    // Deflate
+	header.push_back(0);                    // Adaptive filtering
+	header.push_back(0);                    // Not interlaced
+	appendBE32(header, crc32(0, &header[typeOffset], header.size() - typeOffset));
+
+	FILE *file = std::fopen(path, "wb");
+	if(!file)
+	{
+		error = std::string("cannot create ") + path + ": " + std::strerror(errno);
+		return false;
+	}
+	bool ok = std::fwrite(header.data(), 1, header.size(), file) == header.size();
+	for(int band = 0; band < numBands && ok; band++)
+	{
+		// The length excludes the type and the CRC
+		std::vector<unsigned char> length;
+		appendBE32(length, uint32_t(chunks[band].size() - 8));
+		ok = std::fwrite(length.data(), 1, 4, file) == 4 &&
+		     std::fwrite(chunks[band].data(), 1, chunks[band].size(), file) == chunks[band].size();
+	}
+	static const unsigned char end[12] = {0, 0, 0, 0, 'I', 'E', 'N', 'D', 0xAE, 0x42, 0x60, 0x82};
+	ok = ok && std::fwrite(end, 1, sizeof(end), file) == sizeof(end);
+	if(std::fclose(file) != 0)
+		ok = false;
+	if(!ok)
+		error = std::string("error writing ") + path;
+	return ok;
+}
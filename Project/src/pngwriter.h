@@ -0,0 +1,21 @@
+//pngwriter.h
+#ifndef _PNGWRITER_H_
+#define _PNGWRITER_H_
+
+#include <atomic>
+#include <string>
+
+// Filtered bytes per band of rows compressed on its own
+#define PNG_BAND_BYTES (256 * 1024)
+
+// Writes 8-bit RGB (channels 3) or RGBA (channels 4) pixels as a PNG, rows given bottom row
+// first if bottomUp. The image is cut into bands of rows that are filtered and deflated on
+// numThreads threads (<= 0 for all). Each band ends on a byte boundary with an empty stored
+// block, so the bands concatenate into one zlib stream and each becomes its own IDAT chunk;
+// a band's matches only lose the previous band's bytes as history. rowsDone, if given,
+// counts rows as their band is finished. Returns false and sets error if the file cannot
+// be written.
+bool writePNG(const char *path, int width, int height, int channels, const unsigned char *pixels, bool bottomUp,
+              int numThreads, std::string& error, std::atomic<int> *rowsDone = NULL);
+
+#endif
@@ -3,13 +3,13 @@
 
 #include "lightsource.h"
 
-class PointLightSource : public LightSource
+class PointLightSource final : public LightSource
 {
 private:
 	Vector3D position;
 public:
 	PointLightSource(World *_world, const Vector3D& _pos, const Color& _intensity):
-		LightSource(_world, _intensity), position(_pos) {}
+		LightSource(_world, _intensity, POINT), position(_pos) {}
 	Vector3D getPosition() const {return position;}
 };
 #endif
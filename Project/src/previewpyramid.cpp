@@ -0,0 +1,113 @@
+//previewpyramid.cpp
+
+#include "previewpyramid.h"
+#include <algorithm>
+
+PreviewPyramid::PreviewPyramid(const FrameBuffer *fb, int levelCount):
+	framebuffer(fb), numLevels(std::min(std::max(levelCount, 1), PREVIEW_LEVELS))
+{
+	widths[0] = fb->getWidth();
+	heights[0] = fb->getHeight();
+	levels[0] = NULL;
+	for(int l = 1; l < numLevels; l++)
+	{
+		widths[l] = (widths[l-1] + 1) / 2;
+		heights[l] = (heights[l-1] + 1) / 2;
+		levels[l] = new float[std::size_t(widths[l]) * heights[l] * 3];
+	}
+	clear();
+}
+
+PreviewPyramid::~PreviewPyramid()
+{
+	for(int l = 1; l < numLevels; l++)
+		delete []levels[l];
+}
+
+void PreviewPyramid::clear()
+{
+	for(int l = 1; l < numLevels; l++)
+		std::fill(levels[l], levels[l] + std::size_t(widths[l]) * heights[l] * 3, 0.0f);
+}
+
+int PreviewPyramid::chooseLevel(int width, int height) const
+{
+	int level = 0;
+	while(level + 1 < numLevels && widths[level + 1] >= width && heights[level + 1] >= height)
+		level++;
+	return level;
+}
+
+PixelRect PreviewPyramid::toLevel(const PixelRect& rect, int level) const
+{
+	int x0 = rect.x >> level, y0 = rect.y >> level;
+	int x1 = (rect.x + rect.width + (1 << level) - 1) >> level;
+	int y1 = (rect.y + rect.height + (1 << level) - 1) >> level;
+	PixelRect r = {x0, y0, x1 - x0, y1 - y0};
+	return r;
+}
+
+inline void PreviewPyramid::getTexel(int level, int i, int j, float rgb[3]) const
+{
+	if(level == 0)
+	{
+		Color c = framebuffer->getMean(i, j);
+		rgb[0] = c.r;
+		rgb[1] = c.g;
+		rgb[2] = c.b;
+		return;
+	}
+	const float *t = levels[level] + (std::size_t(j) * widths[level] + i) * 3;
+	rgb[0] = t[0];
+	rgb[1] = t[1];
+	rgb[2] = t[2];
+}
+
+void PreviewPyramid::update(const PixelRect& rect)
+{
+	for(int l = 1; l < numLevels; l++)
+	{
+		// Averages over the texels that exist, so the last row and column of an odd size keep their brightness
+		PixelRect r = toLevel(rect, l);
+		for(int j = r.y; j < r.y + r.height; j++)
+			for(int i = r.x; i < r.x + r.width; i++)
+			{
+				float sum[3] = {0.0f, 0.0f, 0.0f};
+				int n = 0;
+				for(int fj = 2*j; fj < std::min(2*j + 2, heights[l-1]); fj++)
+					for(int fi = 2*i; fi < std::min(2*i + 2, widths[l-1]); fi++)
+					{
+						float rgb[3];
+						getTexel(l - 1, fi, fj, rgb);
+						sum[0] += rgb[0];
+						sum[1] += rgb[1];
+						sum[2] += rgb[2];
+						n++;
+					}
+				float *t = levels[l] + (std::size_t(j) * widths[l] + i) * 3;
+				for(int c = 0; c < 3; c++)
+					t[c] = sum[c] / n;
+			}
+	}
+}
+
+void PreviewPyramid::resolve(int level, unsigned char *pixels, int channels, const PixelRect& rect) const
+{
+	if(level == 0)
+	{
+		framebuffer->resolve(pixels, channels, rect);
+		return;
+	}
+	for(int j = rect.y; j < rect.y + rect.height; j++)
+	{
+		const float *t = levels[level] + (std::size_t(j) * widths[level] + rect.x) * 3;
+		unsigned char *row = pixels + std::size_t(j - rect.y) * rect.width * channels;
+		for(int i = 0; i < rect.width; i++)
+		{
+			for(int c = 0; c < 3; c++)
+				row[i*channels + c] = (unsigned char)(255.0f * std::min(std::max(t[i*3 + c], 0.0f), 1.0f));
+			if(channels == 4)
+				row[i*channels + 3] = 255;
+		}
+	}
+}
@@ -0,0 +1,48 @@
+//previewpyramid.h
+#ifndef _PREVIEWPYRAMID_H_
+#define _PREVIEWPYRAMID_H_
+
+#include "framebuffer.h"
+
+// Levels including the full resolution image: 1, 1/2, 1/4 and 1/8
+#define PREVIEW_LEVELS 4
+
+// Box-filtered reductions of a frame buffer's running mean, for showing a large render in a
+// small window. Level 0 is the frame buffer itself and every further level halves both sides,
+// each texel averaging the up to 2x2 texels of the level before it. The levels are refreshed
+// region by region as the image is rendered, so a display that uploads only the level matching
+// its size pays for that size rather than for the render's. Regions aligned to 2^(levels-1)
+// pixels touch disjoint texels on every level and may be updated from several threads at once.
+class PreviewPyramid
+{
+private:
+	const FrameBuffer *framebuffer;
+	int numLevels;
+	int widths[PREVIEW_LEVELS], heights[PREVIEW_LEVELS];
+	float *levels[PREVIEW_LEVELS]; // Mean RGB of each texel; levels[0] is unused
+
+	void getTexel(int level, int i, int j, float rgb[3]) const;
+
+	PreviewPyramid(const PreviewPyramid&);
+	PreviewPyramid& operator=(const PreviewPyramid&);
+
+public:
+	PreviewPyramid(const FrameBuffer *fb, int levelCount = PREVIEW_LEVELS);
+	~PreviewPyramid();
+
+	int getNumLevels() const {return numLevels;}
+	int getWidth(int level) const {return widths[level];}
+	int getHeight(int level) const {return heights[level];}
+	// Coarsest level at least as large as width x height, so it is never magnified on screen
+	int chooseLevel(int width, int height) const;
+	// Texels of level covering a rectangle of full resolution pixels
+	PixelRect toLevel(const PixelRect& rect, int level) const;
+
+	// Recompute every level over a rectangle of full resolution pixels whose mean changed
+	void update(const PixelRect& rect);
+	// Zero every level, after the frame buffer is cleared
+	void clear();
+	// As FrameBuffer::resolve, for a rectangle of texels of level
+	void resolve(int level, unsigned char *pixels, int channels, const PixelRect& rect) const;
+};
+#endif
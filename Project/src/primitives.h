@@ -0,0 +1,35 @@
+//primitives.h
+#ifndef _PRIMITIVES_H_
+#define _PRIMITIVES_H_
+
+#include "object.h"
+#include "sphere.h"
+#include "triangle.h"
+#include "transformedSurface.h"
+#include "sphereset.h"
+#include "trianglemesh.h"
+#include "compressedmesh.h"
+
+// Dispatch an intersection on the object's type tag. Every branch is a direct,
+// non-virtual call, so the hot loops need neither RTTI nor a vtable lookup.
+inline bool intersectObject(const Object* object, Ray& ray)
+{
+    switch(object->getType())
+    {
+        case Object::SPHERE:
+            return static_cast<const Sphere*>(object)->intersect(ray);
+        case Object::TRIANGLE:
+            return static_cast<const Triangle*>(object)->intersect(ray);
+        case Object::TRANSFORMED_SURFACE:
+            return static_cast<const TransformedSurface*>(object)->intersect(ray);
+        case Object::SPHERE_SET:
+            return static_cast<const SphereSet*>(object)->intersect(ray);
+        case Object::MESH:
+            return static_cast<const TriangleMesh*>(object)->intersect(ray);
+        case Object::COMPRESSED_MESH:
+            return static_cast<const CompressedMesh*>(object)->intersect(ray);
+    }
+    return false;
+}
+
+#endif
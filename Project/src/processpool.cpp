@@ -0,0 +1,156 @@
+//processpool.cpp
+
+#include "processpool.h"
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Lives in memory shared by all processes of the pool
+struct RenderProcessPool::Shared
+{
+	sem_t start; // Posted once per process for each pass, and to stop
+	sem_t done;  // Posted by each process when it finds no tiles left
+	std::atomic<int> nextTile;
+	std::atomic<int> activePixels;
+	// The engine's progress before the pass, which the processes' copies of it take on
+	int pass, lastActivePixels;
+	long long samplesTaken;
+	bool stopping;
+};
+
+bool RenderProcessPool::start(RenderEngine *_engine, FrameBuffer *framebuffer, int numProcesses, int numThreads, std::string& error)
+{
+	engine = _engine;
+	if(!framebuffer->moveToSharedMemory(error))
+		return false;
+	void *memory = mmap(NULL, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(memory == MAP_FAILED)
+	{
+		error = std::string("cannot map shared memory for render processes: ") + std::strerror(errno);
+		return false;
+	}
+	shared = new (memory) Shared();
+	sem_init(&shared->start, 1, 0);
+	sem_init(&shared->done, 1, 0);
+	shared->stopping = false;
+
+	if(numThreads <= 0)
+		numThreads = std::max(1, defaultThreadCount() / numProcesses);
+	// Output still buffered would be written again by every process
+	std::fflush(stdout);
+	std::fflush(stderr);
+	for(int p = 0; p < numProcesses; p++)
+	{
+		pid_t pid = fork();
+		if(pid == 0)
+		{
+			work(numThreads);
+			_exit(0);
+		}
+		if(pid < 0)
+		{
+			error = std::string("cannot start render process: ") + std::strerror(errno);
+			stop();
+			return false;
+		}
+		workers.push_back(pid);
+	}
+	return true;
+}
+
+// Body of each forked process. _exit() afterwards skips destructors of state it only has a copy of.
+void RenderProcessPool::work(int numThreads)
+{
+	for(;;)
+	{
+		while(sem_wait(&shared->start) != 0 && errno == EINTR)
+			;
+		if(shared->stopping)
+			return;
+		engine->resume(shared->pass, shared->samplesTaken, shared->lastActivePixels);
+		shared->activePixels += engine->renderTiles(shared->nextTile, numThreads);
+		sem_post(&shared->done);
+	}
+}
+
+bool RenderProcessPool::waitForWorkers(std::string& error)
+{
+	// A process that died never posts, so the wait times out regularly to look for one
+	for(std::size_t finished = 0; finished < workers.size();)
+	{
+		timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += 100000000;
+		if(deadline.tv_nsec >= 1000000000)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+		if(sem_timedwait(&shared->done, &deadline) == 0)
+		{
+			finished++;
+			continue;
+		}
+		if(errno != ETIMEDOUT)
+			continue;
+		for(std::size_t w = 0; w < workers.size(); w++)
+		{
+			int status;
+			if(workers[w] > 0 && waitpid(workers[w], &status, WNOHANG) == workers[w])
+			{
+				error = "render process " + std::to_string(workers[w]) + " died" +
+				        (WIFSIGNALED(status) ? std::string(": ") + strsignal(WTERMSIG(status)) : std::string());
+				workers[w] = 0;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool RenderProcessPool::renderPass(std::string& error)
+{
+	if(engine->isDone())
+		return true;
+	shared->pass = engine->getPass();
+	shared->samplesTaken = engine->getSamplesTaken();
+	shared->lastActivePixels = engine->getActivePixels();
+	shared->nextTile = 0;
+	shared->activePixels = 0;
+	for(std::size_t w = 0; w < workers.size(); w++)
+		sem_post(&shared->start);
+	if(!waitForWorkers(error))
+	{
+		stop();
+		return false;
+	}
+	engine->finishPass(shared->activePixels);
+	return true;
+}
+
+void RenderProcessPool::stop()
+{
+	if(!shared)
+		return;
+	shared->stopping = true;
+	for(std::size_t w = 0; w < workers.size(); w++)
+		sem_post(&shared->start);
+	for(std::size_t w = 0; w < workers.size(); w++)
+		if(workers[w] > 0)
+			waitpid(workers[w], NULL, 0);
+	workers.clear();
+	sem_destroy(&shared->start);
+	sem_destroy(&shared->done);
+	shared->~Shared();
+	munmap(shared, sizeof(Shared));
+	shared = NULL;
+}
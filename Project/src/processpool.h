@@ -0,0 +1,45 @@
+//processpool.h
+#ifndef _PROCESSPOOL_H_
+#define _PROCESSPOOL_H_
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "framebuffer.h"
+#include "renderengine.h"
+
+// Renders the passes of a RenderEngine on forked processes instead of threads of one process, so
+// each has its own heap and allocator and, on NUMA machines, its own memory. The processes are
+// forked once the scene and its acceleration structure are built and share them copy-on-write;
+// they write into the frame buffer in shared memory and claim tiles through an atomic counter
+// that lives there too. The calling process only hands out passes.
+class RenderProcessPool
+{
+private:
+	struct Shared;
+	Shared *shared; // Anonymous shared mapping, NULL until started
+	std::vector<pid_t> workers;
+	RenderEngine *engine;
+
+	void work(int numThreads);
+	bool waitForWorkers(std::string& error);
+
+	RenderProcessPool(const RenderProcessPool&);
+	RenderProcessPool& operator=(const RenderProcessPool&);
+
+public:
+	RenderProcessPool(): shared(NULL), engine(NULL) {}
+	~RenderProcessPool() {stop();}
+
+	// Moves framebuffer, the one engine renders to, into shared memory and forks numProcesses
+	// processes of numThreads threads each (0 to divide the hardware threads between them). Must be
+	// called while no other thread is running, as only the calling thread survives fork. Returns
+	// false and sets error if the shared memory or a process cannot be created.
+	bool start(RenderEngine *_engine, FrameBuffer *framebuffer, int numProcesses, int numThreads, std::string& error);
+	// Like RenderEngine::renderPass(). Returns false and sets error, stopping the pool, if a
+	// process has died.
+	bool renderPass(std::string& error);
+	// Ends the processes
+	void stop();
+};
+#endif
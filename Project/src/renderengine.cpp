@@ -1,26 +1,247 @@
 #include "renderengine.h"
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+
+// Store the primary hit's normal, albedo and depth for the denoiser. Rays that miss
+// everything get a zero normal and depth and the background as albedo.
+void RenderEngine::recordFeatures(const int i, const int j, const Ray& ray)
+{
+	if(ray.didHit())
+		camera->getFrameBuffer()->addFeatures(i, j, ray.getNormal(), ray.intersected()->getMaterial()->color, ray.getParameter());
+	else
+		camera->getFrameBuffer()->addFeatures(i, j, Vector3D(0, 0, 0), world->getBackground(), 0.0f);
+}
 
 const Color RenderEngine::trace(const int i, const int j, const int samples)
 {
 	Vector3D ray_dir = camera->get_ray_direction(i, j, samples);
 	Ray ray(camera->get_position(), ray_dir);
-	return world->shade_ray(ray);
+	Color color = world->shade_ray(ray);
+	recordFeatures(i, j, ray);
+	return color;
+}
+
+const Color RenderEngine::traceJittered(const int i, const int j, Sampler& pixelSampler)
+{
+	// The pixel's sample count is its index into the sampler's sequence, so adaptive
+	// sampling keeps drawing consecutive, well-distributed points for every pixel
+	float offsetX, offsetY;
+	pixelSampler.startPixelSample(i, camera->getFirstRow() + j, camera->getFrameBuffer()->getSampleCount(i, j));
+	pixelSampler.sample2D(DIM_PIXEL, offsetX, offsetY);
+	Vector3D ray_dir = camera->get_sample_direction(i, j, offsetX, offsetY);
+	Ray ray(camera->get_position(), ray_dir);
+	Color color = world->shade_ray(ray);
+	recordFeatures(i, j, ray);
+	return color;
+}
+
+int RenderEngine::getTargetPasses() const
+{
+	if(!progressive)
+		return 1;
+	return adaptive ? maxSamples : targetSamples;
+}
+
+// Adds one sample to pixel (i, j) of the current pass. Returns false if adaptive
+// sampling skipped the pixel because it has already converged.
+bool RenderEngine::renderPixel(const int i, const int j, Sampler& pixelSampler)
+{
+	// Every pixel needs two samples before its variance can be estimated
+	if(adaptive && pass >= 2 && camera->getFrameBuffer()->relativeError(i, j) < noiseThreshold)
+		return false;
+
+	Color color = progressive ? traceJittered(i, j, pixelSampler) : trace(i, j, samplesPerPixel);
+	camera->addSample(i, j, color);
+	return true;
+}
+
+int RenderEngine::getNumTiles() const
+{
+	int tilesX = (camera->getWidth() + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+	int tilesY = (camera->getHeight() + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+	return tilesX * tilesY;
+}
+
+// Renders one tile of the current pass and returns the number of pixels sampled
+int RenderEngine::renderTile(const int tile, Sampler& pixelSampler)
+{
+	int tilesX = (camera->getWidth() + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+	int x0 = (tile % tilesX) * RENDER_TILE_SIZE;
+	int y0 = (tile / tilesX) * RENDER_TILE_SIZE;
+	int x1 = std::min(x0 + RENDER_TILE_SIZE, camera->getWidth());
+	int y1 = std::min(y0 + RENDER_TILE_SIZE, camera->getHeight());
+
+	int sampled = 0;
+	for(int j = y0; j < y1; j++)
+		for(int i = x0; i < x1; i++)
+			if(renderPixel(i, j, pixelSampler))
+				sampled++;
+	if(sampled > 0)
+	{
+		if(preview)
+		{
+			PixelRect rect = {x0, y0, x1 - x0, y1 - y0};
+			preview->update(rect);
+		}
+		markDirty(tile);
+	}
+	return sampled;
+}
+
+void RenderEngine::takeDirtyRects(std::vector<PixelRect>& rects)
+{
+	const int width = camera->getWidth(), height = camera->getHeight();
+	const int tilesX = (width + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+	const int tilesY = (height + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+	std::vector<uint64_t> dirty((getNumTiles() + 63) / 64);
+	for(std::size_t w = 0; w < dirty.size(); w++)
+		dirty[w] = dirtyTiles[w].exchange(0, std::memory_order_acquire);
+
+	// Vertical runs of dirty tiles, merged with the run of the previous tile column if it
+	// covers the same rows: progressive columns and whole passes both become a few rectangles
+	rects.clear();
+	for(int tx = 0; tx < tilesX; tx++)
+	{
+		int start = -1;
+		for(int ty = 0; ty <= tilesY; ty++)
+		{
+			int tile = tx + ty * tilesX;
+			bool isDirty = ty < tilesY && (dirty[tile >> 6] >> (tile & 63) & 1);
+			if(isDirty && start < 0)
+				start = ty;
+			if(isDirty || start < 0)
+				continue;
+
+			PixelRect rect = {tx * RENDER_TILE_SIZE, start * RENDER_TILE_SIZE, 0, 0};
+			rect.width = std::min(RENDER_TILE_SIZE, width - rect.x);
+			rect.height = std::min(ty * RENDER_TILE_SIZE, height) - rect.y;
+			start = -1;
+			bool merged = false;
+			for(std::size_t r = 0; r < rects.size() && !merged; r++)
+				if(rects[r].x + rects[r].width == rect.x && rects[r].y == rect.y && rects[r].height == rect.height)
+				{
+					rects[r].width += rect.width;
+					merged = true;
+				}
+			if(!merged)
+				rects.push_back(rect);
+		}
+	}
 }
 
+void RenderEngine::finishPass(int passActivePixels)
+{
+	pass++;
+	samplesTaken += passActivePixels;
+	lastActivePixels = passActivePixels;
+	updateDone();
+}
+
+void RenderEngine::updateDone()
+{
+	if(pass >= getTargetPasses())
+		done = true;
+	if(adaptive && pass > 0)
+	{
+		long long budget = (long long)targetSamples * getRangePixels();
+		if(lastActivePixels == 0 || samplesTaken >= budget)
+			done = true;
+	}
+}
+
+long long RenderEngine::getRangePixels() const
+{
+	if(tileCount < 0)
+		return (long long)camera->getWidth() * camera->getHeight();
+	const int tilesX = (camera->getWidth() + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+	long long pixels = 0;
+	for(int tile = firstTile; tile < firstTile + tileCount; tile++)
+	{
+		int x0 = (tile % tilesX) * RENDER_TILE_SIZE, y0 = (tile / tilesX) * RENDER_TILE_SIZE;
+		pixels += (long long)std::min(RENDER_TILE_SIZE, camera->getWidth() - x0) * std::min(RENDER_TILE_SIZE, camera->getHeight() - y0);
+	}
+	return pixels;
+}
+
+void RenderEngine::resume(int passes, long long samples, int activePixelsLastPass)
+{
+	pass = passes;
+	samplesTaken = samples;
+	lastActivePixels = activePixelsLastPass;
+	column = 0;
+	activePixels = 0;
+	done = false;
+	updateDone();
+}
+
+// Renders one column of the current pass. Returns true once the render is complete;
+// further calls do nothing instead of starting the image over.
 bool RenderEngine::renderLoop()
 {
-	static int i = 0;
+	if(done)
+		return true;
+
+	const int tilesX = (camera->getWidth() + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+	int lastTile = -1, firstRow = -1, lastRow = -1;
 	for(int j = 0; j<camera->getHeight(); j++)
+		if(renderPixel(column, j, *sampler))
+		{
+			activePixels++;
+			int tile = column / RENDER_TILE_SIZE + (j / RENDER_TILE_SIZE) * tilesX;
+			if(tile != lastTile)
+				markDirty(tile);
+			lastTile = tile;
+			if(firstRow < 0)
+				firstRow = j;
+			lastRow = j;
+		}
+	if(preview && firstRow >= 0)
 	{
-		Color color = trace(i, j, samplesPerPixel);
-		color.clamp();
-		camera->drawPixel(i, j, color);
+		PixelRect rect = {column, firstRow, 1, lastRow - firstRow + 1};
+		preview->update(rect);
 	}
 
-	if(++i == camera->getWidth())
+	if(++column == camera->getWidth())
 	{
-		i = 0;
-		return true;
+		column = 0;
+		finishPass(activePixels);
+		activePixels = 0;
 	}
-	return false;
+	return done;
+}
+
+void RenderEngine::render(int numThreads)
+{
+	while(!done)
+		renderPass(numThreads);
+}
+
+void RenderEngine::renderPass(int numThreads)
+{
+	if(done)
+		return;
+	std::atomic<int> nextTile(0);
+	finishPass(renderTiles(nextTile, numThreads));
+}
+
+int RenderEngine::renderTiles(std::atomic<int>& nextTile, int numThreads)
+{
+	if(numThreads <= 0)
+		numThreads = defaultThreadCount();
+
+	const int first = tileCount < 0 ? 0 : firstTile;
+	const int numTiles = tileCount < 0 ? getNumTiles() : tileCount;
+	std::atomic<int> passActivePixels(0);
+
+	// One chunk per thread; the tiles themselves are balanced through the shared counter
+	parallelFor(0, numThreads, numThreads, [&](int, int) {
+		Sampler *threadSampler = sampler->clone();
+		int sampled = 0;
+		for(int claim = nextTile++; claim < numTiles; claim = nextTile++)
+			sampled += renderTile(first + claim, *threadSampler);
+		passActivePixels += sampled;
+		delete threadSampler;
+	});
+	return passActivePixels;
 }
@@ -1,8 +1,17 @@
 #ifndef _RENDERENGINE_H_
 #define _RENDERENGINE_H_
 
+#include <atomic>
+#include <stdint.h>
+#include <vector>
 #include "world.h"
 #include "camera.h"
+#include "sampler.h"
+#include "previewpyramid.h"
+
+// Edge length of the square tiles handed out to render threads: the frame buffer's storage
+// tiles, so each thread writes to memory of its own
+#define RENDER_TILE_SIZE FRAMEBUFFER_TILE_SIZE
 
 class RenderEngine
 {
@@ -10,11 +19,75 @@ private:
 	World *world;
 	Camera *camera;
 	const Color trace(const int i, const int j, const int samples);
+	const Color traceJittered(const int i, const int j, Sampler& pixelSampler);
+	bool renderPixel(const int i, const int j, Sampler& pixelSampler);
+	int renderTile(const int tile, Sampler& pixelSampler);
+	void markDirty(const int tile) {dirtyTiles[tile >> 6].fetch_or(uint64_t(1) << (tile & 63), std::memory_order_release);}
+	void updateDone();
+	long long getRangePixels() const;
+	void recordFeatures(const int i, const int j, const Ray& ray);
     int samplesPerPixel; // Number of samples per pixel (n)
+    Sampler *sampler; // Source of the progressive jitter
+
+    bool progressive; // Add one jittered sample per pixel per pass instead of one n x n pass
+    int targetSamples; // Number of progressive passes to run
+    int column; // Next column to render in the current pass
+    int pass; // Number of completed passes
+    bool done;
+
+    bool adaptive; // Skip pixels whose noise is below the threshold
+    float noiseThreshold; // Relative standard error at which a pixel counts as converged
+    int maxSamples; // Upper bound on samples for a single unconverged pixel
+    long long samplesTaken; // Samples traced so far, compared against the budget of targetSamples per pixel
+    int activePixels; // Pixels that received a sample in the current pass
+    int lastActivePixels; // Pixels that received a sample in the last completed pass
+    int firstTile, tileCount; // Tiles render() covers; tileCount < 0 for the whole image
+    std::atomic<uint64_t> *dirtyTiles; // One bit per tile that received samples since takeDirtyRects
+    PreviewPyramid *preview; // Refreshed as tiles and columns complete, if set
 
 public:
 	RenderEngine(World *_world, Camera *_camera, int samples):
-		world(_world), camera(_camera), samplesPerPixel(samples) {}
+		world(_world), camera(_camera), samplesPerPixel(samples), sampler(new SobolSampler()),
+		progressive(false), targetSamples(1), column(0), pass(0), done(false),
+		adaptive(false), noiseThreshold(0), maxSamples(0), samplesTaken(0), activePixels(0), lastActivePixels(0),
+		firstTile(0), tileCount(-1), dirtyTiles(new std::atomic<uint64_t>[(getNumTiles() + 63) / 64]()), preview(NULL) {}
+	~RenderEngine() {delete sampler; delete []dirtyTiles;}
+	void setSampler(Sampler *s) {delete sampler; sampler = s;}
+	const Sampler* getSampler() const {return sampler;}
+	void setPreview(PreviewPyramid *p) {preview = p;} // Not owned
+	void setProgressive(int target) {progressive = true; targetSamples = target;}
+	// Adaptive sampling builds on progressive mode: converged pixels stop receiving samples
+	// and the saved budget goes to the remaining ones, up to _maxSamples each.
+	void setAdaptive(float threshold, int _maxSamples) {adaptive = true; noiseThreshold = threshold; maxSamples = _maxSamples;}
+	// Restrict render() and renderPass() to tiles [first, first + count), numbered row by row; the
+	// adaptive budget is then shared by those tiles' pixels only. renderLoop() ignores the range.
+	void setTileRange(int first, int count) {firstTile = first; tileCount = count;}
+	void setNoiseThreshold(float threshold) {noiseThreshold = threshold;}
+	float getNoiseThreshold() const {return noiseThreshold;}
+	bool isAdaptive() const {return adaptive;}
+	int getActivePixels() const {return lastActivePixels;}
 	bool renderLoop();
+	// Render every remaining pass on numThreads threads (0 = all hardware threads). Threads
+	// claim tiles from a shared counter and each draws from its own clone of the sampler.
+	void render(int numThreads);
+	// One pass of render(), so the caller can act between passes. Does nothing once done.
+	void renderPass(int numThreads);
+	// The tiles of one pass, on numThreads threads that claim them through nextTile, counting from
+	// 0, until all are claimed. Returns the number of pixels sampled. Threads of other processes
+	// may share nextTile and the frame buffer; once all have returned, finishPass() is called
+	// with their total.
+	int renderTiles(std::atomic<int>& nextTile, int numThreads);
+	void finishPass(int passActivePixels);
+	// Continue a render that had completed passes and taken samples when it was saved, such as
+	// from a checkpoint with the frame buffer restored. The sample target may since have been raised.
+	void resume(int passes, long long samples, int activePixelsLastPass);
+	long long getSamplesTaken() const {return samplesTaken;}
+	int getNumTiles() const;
+	// Regions that received samples since the last call, as runs of tiles. Render threads mark
+	// tiles without locking, so this may be called from another thread while they run.
+	void takeDirtyRects(std::vector<PixelRect>& rects);
+	bool isDone() const {return done;}
+	int getPass() const {return pass;}
+	int getTargetPasses() const;
 };
 #endif
@@ -0,0 +1,310 @@
+//sampler.cpp
+
+#include "sampler.h"
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+// Hash used to derive independent seeds (lowbias32 by Chris Wellons)
+static inline unsigned int hashUint(unsigned int x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+static inline unsigned int hashCombine(unsigned int seed, unsigned int v)
+{
+	return hashUint(seed ^ (v + 0x9e3779b9u + (seed << 6) + (seed >> 2)));
+}
+
+// Map 32 random bits to [0, 1) without ever rounding up to 1
+static inline float toUnitFloat(unsigned int x)
+{
+	return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+static inline unsigned int reverseBits(unsigned int x)
+{
+	x = (x << 16) | (x >> 16);
+	x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+	x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+	x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+	x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+	return x;
+}
+
+// Owen scrambling through a hash-based nested uniform permutation (Burley 2020)
+static inline unsigned int nestedUniformScramble(unsigned int x, unsigned int seed)
+{
+	x = reverseBits(x);
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return reverseBits(x);
+}
+
+// First two dimensions of the Sobol sequence
+static inline unsigned int sobol2D(unsigned int index, int dimension)
+{
+	if(dimension == 0)
+		return reverseBits(index);
+
+	unsigned int result = 0;
+	for(unsigned int v = 1u << 31; index; index >>= 1, v ^= v >> 1)
+		if(index & 1)
+			result ^= v;
+	return result;
+}
+
+// Owen-scrambled, shuffled 2D Sobol padded across dimension pairs
+static inline float scrambledSobol(unsigned int index, int dimension, unsigned int seed)
+{
+	unsigned int pairSeed = hashCombine(seed, dimension / 2);
+	unsigned int shuffled = nestedUniformScramble(index, pairSeed);
+	unsigned int x = sobol2D(shuffled, dimension & 1);
+	return toUnitFloat(nestedUniformScramble(x, hashCombine(pairSeed, dimension & 1)));
+}
+
+void Sampler::startPixelSample(int i, int j, unsigned int index)
+{
+	pixelX = i;
+	pixelY = j;
+	sampleIndex = index;
+	pixelSeed = hashCombine(hashUint(i), j);
+}
+
+float RandomSampler::sample(int dimension) const
+{
+	return toUnitFloat(hashCombine(hashCombine(pixelSeed, sampleIndex), dimension));
+}
+
+static unsigned int gcd(unsigned int a, unsigned int b)
+{
+	while(b)
+	{
+		unsigned int t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+StratifiedSampler::StratifiedSampler(int samples):
+	samplesPerPixel(samples < 1 ? 1 : samples)
+{
+	nx = (int)ceil(sqrt((double)samplesPerPixel));
+	ny = (samplesPerPixel + nx - 1) / nx;
+}
+
+float StratifiedSampler::sample(int dimension) const
+{
+	unsigned int dimSeed = hashCombine(pixelSeed, dimension / 2);
+	unsigned int jitter = hashCombine(hashCombine(dimSeed, sampleIndex), dimension & 1);
+
+	// Samples beyond the planned count start a new, differently permuted round of strata
+	unsigned int strata = nx * ny;
+	unsigned int round = sampleIndex / strata;
+	unsigned int stratum = sampleIndex % strata;
+	unsigned int roundSeed = hashCombine(dimSeed, round);
+
+	// Random permutation of the strata: an affine map stratum * a + b is a bijection when gcd(a, strata) = 1
+	unsigned int a = 1 + roundSeed % strata;
+	while(gcd(a, strata) != 1)
+		a++;
+	unsigned int permuted = (unsigned int)(((unsigned long long)stratum * a + (roundSeed >> 8)) % strata);
+
+	int sx = permuted % nx;
+	int sy = permuted / nx;
+	int s = (dimension & 1) ? sy : sx;
+	int n = (dimension & 1) ? ny : nx;
+	return (s + toUnitFloat(jitter)) / n;
+}
+
+static const int NUM_HALTON_PRIMES = 16;
+static const unsigned int haltonPrimes[NUM_HALTON_PRIMES] =
+	{2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53};
+
+static inline float radicalInverse(unsigned int index, unsigned int base)
+{
+	double invBase = 1.0 / base;
+	double invBaseN = 1.0;
+	unsigned long long reversed = 0;
+	while(index)
+	{
+		unsigned int next = index / base;
+		unsigned int digit = index - next * base;
+		reversed = reversed * base + digit;
+		invBaseN *= invBase;
+		index = next;
+	}
+	return (float)(reversed * invBaseN);
+}
+
+float HaltonSampler::sample(int dimension) const
+{
+	unsigned int rotation = hashCombine(pixelSeed, dimension);
+	if(dimension >= NUM_HALTON_PRIMES)
+		return toUnitFloat(hashCombine(rotation, sampleIndex));
+
+	float x = radicalInverse(sampleIndex, haltonPrimes[dimension]) + toUnitFloat(rotation);
+	if(x >= 1.0f)
+		x -= 1.0f;
+	return x < 1.0f ? x : 0.0f;
+}
+
+float SobolSampler::sample(int dimension) const
+{
+	return scrambledSobol(sampleIndex, dimension, pixelSeed);
+}
+
+// Tileable blue-noise mask built once with the void-and-cluster method (Ulichney 1993)
+static const int BLUE_NOISE_SIZE = 64;
+
+class BlueNoiseMask
+{
+private:
+	static const int N = BLUE_NOISE_SIZE * BLUE_NOISE_SIZE;
+	float kernel[N]; // Gaussian of the toroidal distance to pixel 0
+	float value[N];
+
+	void splat(std::vector<float>& energy, int p, float sign) const
+	{
+		int px = p % BLUE_NOISE_SIZE, py = p / BLUE_NOISE_SIZE;
+		for(int y = 0; y < BLUE_NOISE_SIZE; y++)
+		{
+			int dy = (y - py + BLUE_NOISE_SIZE) % BLUE_NOISE_SIZE;
+			for(int x = 0; x < BLUE_NOISE_SIZE; x++)
+			{
+				int dx = (x - px + BLUE_NOISE_SIZE) % BLUE_NOISE_SIZE;
+				energy[y*BLUE_NOISE_SIZE + x] += sign * kernel[dy*BLUE_NOISE_SIZE + dx];
+			}
+		}
+	}
+
+	// Tightest cluster (value true) or largest void (value false)
+	int extreme(const std::vector<float>& energy, const std::vector<char>& pattern, bool cluster) const
+	{
+		int best = -1;
+		for(int p = 0; p < N; p++)
+		{
+			if(pattern[p] != (char)cluster)
+				continue;
+			if(best < 0 || (cluster ? energy[p] > energy[best] : energy[p] < energy[best]))
+				best = p;
+		}
+		return best;
+	}
+
+public:
+	BlueNoiseMask()
+	{
+		const float sigma = 1.5f;
+		for(int y = 0; y < BLUE_NOISE_SIZE; y++)
+			for(int x = 0; x < BLUE_NOISE_SIZE; x++)
+			{
+				int dx = x < BLUE_NOISE_SIZE/2 ? x : BLUE_NOISE_SIZE - x;
+				int dy = y < BLUE_NOISE_SIZE/2 ? y : BLUE_NOISE_SIZE - y;
+				kernel[y*BLUE_NOISE_SIZE + x] = expf(-(dx*dx + dy*dy) / (2.0f*sigma*sigma));
+			}
+
+		// Initial random pattern with 10% of the pixels set, relaxed until stable
+		std::vector<char> pattern(N, 0);
+		std::vector<float> energy(N, 0.0f);
+		int ones = 0;
+		for(int p = 0; p < N; p++)
+			if(hashUint(p) % 10 == 0)
+			{
+				pattern[p] = 1;
+				splat(energy, p, 1.0f);
+				ones++;
+			}
+		for(int iter = 0; iter < N; iter++)
+		{
+			int cluster = extreme(energy, pattern, true);
+			pattern[cluster] = 0;
+			splat(energy, cluster, -1.0f);
+			int hole = extreme(energy, pattern, false);
+			pattern[hole] = 1;
+			splat(energy, hole, 1.0f);
+			if(hole == cluster)
+				break;
+		}
+
+		std::vector<int> rank(N, 0);
+
+		// Phase 1: rank the initial points by repeatedly removing the tightest cluster
+		std::vector<char> work(pattern);
+		std::vector<float> workEnergy(energy);
+		for(int r = ones - 1; r >= 0; r--)
+		{
+			int cluster = extreme(workEnergy, work, true);
+			work[cluster] = 0;
+			splat(workEnergy, cluster, -1.0f);
+			rank[cluster] = r;
+		}
+
+		// Phases 2 and 3: fill the largest void until the mask is full. Past half coverage the
+		// largest void of the ones is the tightest cluster of the zeros, so one loop serves both.
+		for(int r = ones; r < N; r++)
+		{
+			int hole = extreme(energy, pattern, false);
+			pattern[hole] = 1;
+			splat(energy, hole, 1.0f);
+			rank[hole] = r;
+		}
+
+		for(int p = 0; p < N; p++)
+			value[p] = (rank[p] + 0.5f) / N;
+	}
+
+	float at(int x, int y) const
+	{
+		x &= BLUE_NOISE_SIZE - 1;
+		y &= BLUE_NOISE_SIZE - 1;
+		return value[y*BLUE_NOISE_SIZE + x];
+	}
+};
+
+static const BlueNoiseMask& blueNoiseMask()
+{
+	static const BlueNoiseMask mask;
+	return mask;
+}
+
+BlueNoiseSampler::BlueNoiseSampler()
+{
+	// Build the mask up front rather than inside the first render thread
+	blueNoiseMask();
+}
+
+float BlueNoiseSampler::sample(int dimension) const
+{
+	// Every dimension reads the mask at its own toroidal offset
+	unsigned int offset = hashUint(dimension + 1);
+	float rotation = blueNoiseMask().at(pixelX + (offset & 63), pixelY + ((offset >> 6) & 63));
+	float x = scrambledSobol(sampleIndex, dimension, 0x5bd1e995u) + rotation;
+	if(x >= 1.0f)
+		x -= 1.0f;
+	return x < 1.0f ? x : 0.0f;
+}
+
+Sampler* createSampler(const char* name, int samplesPerPixel)
+{
+	if(strcmp(name, "random") == 0)
+		return new RandomSampler();
+	if(strcmp(name, "stratified") == 0)
+		return new StratifiedSampler(samplesPerPixel);
+	if(strcmp(name, "halton") == 0)
+		return new HaltonSampler();
+	if(strcmp(name, "sobol") == 0)
+		return new SobolSampler();
+	if(strcmp(name, "bluenoise") == 0)
+		return new BlueNoiseSampler();
+	return NULL;
+}
@@ -0,0 +1,97 @@
+//sampler.h
+#ifndef _SAMPLER_H_
+#define _SAMPLER_H_
+
+// Sample dimensions reserved for each consumer. Every consumer reads its own pair of
+// dimensions, so e.g. the pixel jitter never correlates with the lens or light samples.
+enum SampleDimension
+{
+	DIM_PIXEL = 0, // Sub-pixel jitter (2D)
+	DIM_LENS  = 2, // Lens position (2D)
+	DIM_LIGHT = 4  // Light sampling (2D)
+};
+
+// Source of sample values in [0, 1). A sampler is positioned on one sample of one pixel with
+// startPixelSample(); sample(dim) then returns dimension dim of that sample. Values only depend
+// on (pixel, sample index, dimension), so results are reproducible for any render order, and a
+// clone() per render thread is all the synchronisation that is needed.
+class Sampler
+{
+protected:
+	int pixelX, pixelY;
+	unsigned int sampleIndex;
+	unsigned int pixelSeed; // Hash of the pixel coordinates
+
+public:
+	Sampler(): pixelX(0), pixelY(0), sampleIndex(0), pixelSeed(0) {}
+	virtual ~Sampler() {}
+
+	void startPixelSample(int i, int j, unsigned int index);
+	virtual float sample(int dimension) const = 0;
+	void sample2D(int dimension, float& u, float& v) const
+	{
+		u = sample(dimension);
+		v = sample(dimension + 1);
+	}
+	virtual Sampler* clone() const = 0;
+	virtual const char* getName() const = 0;
+};
+
+// Independent uniform random samples; the baseline every other sampler is compared to.
+class RandomSampler : public Sampler
+{
+public:
+	float sample(int dimension) const;
+	Sampler* clone() const {return new RandomSampler(*this);}
+	const char* getName() const {return "random";}
+};
+
+// Jittered strata. Any sample count works: strata form an nx x ny grid with nx*ny >= samples,
+// visited in a per-pixel random order.
+class StratifiedSampler : public Sampler
+{
+private:
+	int samplesPerPixel;
+	int nx, ny;
+public:
+	StratifiedSampler(int samples);
+	float sample(int dimension) const;
+	Sampler* clone() const {return new StratifiedSampler(*this);}
+	const char* getName() const {return "stratified";}
+};
+
+// Halton sequence, one prime base per dimension, decorrelated between pixels with a
+// per-pixel Cranley-Patterson rotation.
+class HaltonSampler : public Sampler
+{
+public:
+	float sample(int dimension) const;
+	Sampler* clone() const {return new HaltonSampler(*this);}
+	const char* getName() const {return "halton";}
+};
+
+// Owen-scrambled Sobol (0,2)-sequence. Dimensions are padded in pairs: every pair is an
+// independently shuffled and scrambled 2D Sobol sequence.
+class SobolSampler : public Sampler
+{
+public:
+	float sample(int dimension) const;
+	Sampler* clone() const {return new SobolSampler(*this);}
+	const char* getName() const {return "sobol";}
+};
+
+// Sobol samples shared by all pixels and rotated by a tileable blue-noise mask, so the
+// remaining error is distributed as high-frequency noise that is much less visible.
+class BlueNoiseSampler : public Sampler
+{
+public:
+	BlueNoiseSampler();
+	float sample(int dimension) const;
+	Sampler* clone() const {return new BlueNoiseSampler(*this);}
+	const char* getName() const {return "bluenoise";}
+};
+
+// Create a sampler by name (random, stratified, halton, sobol, bluenoise). Returns NULL for unknown names.
+Sampler* createSampler(const char* name, int samplesPerPixel);
+
+#endif
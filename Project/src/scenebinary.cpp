@@ -0,0 +1,340 @@
+//scenebinary.cpp
+
+#include "scenebinary.h"
+#include "checkpoint.h"
+#include "sphereset.h"
+#include "trianglemesh.h"
+#include <cstdio>
+#include <cstring>
+
+#define BINARY_SCENE_BYTE_ORDER 0x01020304u
+
+// Appends sections at aligned offsets and remembers where each one went, hashing what it writes
+struct BinarySceneWriter
+{
+	FILE *file;
+	uint64_t position;
+	uint64_t hash;
+	bool ok;
+
+	uint64_t write(const void *data, std::size_t bytes)
+	{
+		static const char zeros[BINARY_SCENE_ALIGNMENT] = {0};
+		std::size_t padding = (BINARY_SCENE_ALIGNMENT - position % BINARY_SCENE_ALIGNMENT) % BINARY_SCENE_ALIGNMENT;
+		if(padding)
+		{
+			ok = ok && std::fwrite(zeros, 1, padding, file) == padding;
+			hash = hashBytes(zeros, padding, hash);
+		}
+		position += padding;
+		uint64_t offset = position;
+		if(bytes)
+		{
+			ok = ok && std::fwrite(data, 1, bytes, file) == bytes;
+			hash = hashBytes(data, bytes, hash);
+		}
+		position += bytes;
+		return offset;
+	}
+
+	template<typename T>
+	uint64_t write(const std::vector<T>& v)
+	{
+		return write(v.data(), v.size() * sizeof(T));
+	}
+};
+
+bool writeBinaryScene(const char *path, const SceneDescription& scene, const CompiledScene& compiled, std::string& error)
+{
+	FILE *file = std::fopen(path, "wb");
+	if(!file)
+	{
+		error = std::string("cannot create ") + path;
+		return false;
+	}
+
+	BinarySceneHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, BINARY_SCENE_MAGIC, sizeof(header.magic));
+	header.version = BINARY_SCENE_VERSION;
+	header.byteOrder = BINARY_SCENE_BYTE_ORDER;
+	for(int a = 0; a < 3; a++)
+	{
+		header.cameraPosition[a] = scene.cameraPosition[a];
+		header.cameraTarget[a] = scene.cameraTarget[a];
+		header.cameraUp[a] = scene.cameraUp[a];
+		header.background[a] = scene.background[a];
+	}
+	header.cameraFovY = scene.cameraFovY;
+	header.numPrimitives = scene.getNumPrimitives();
+
+	// The header is written again at the end, once all offsets are known
+	BinarySceneWriter writer = {file, 0, 0, true};
+	writer.write(&header, sizeof(header));
+	writer.hash = hashBytes(NULL, 0);
+
+	header.numMaterials = scene.materials.size();
+	header.materialsOffset = writer.write(scene.materials);
+	header.numLights = scene.lights.size();
+	header.lightsOffset = writer.write(scene.lights);
+	header.numTransforms = scene.transforms.size();
+	header.transformsOffset = writer.write(scene.transforms);
+	header.numTransformedSpheres = compiled.transformedSpheres.size();
+	header.transformedSpheresOffset = writer.write(compiled.transformedSpheres);
+	header.numTransformedTriangles = compiled.transformedTriangles.size();
+	header.transformedTrianglesOffset = writer.write(compiled.transformedTriangles);
+
+	std::vector<BinarySphereSet> sets(compiled.sphereSets.size());
+	for(std::size_t k = 0; k < sets.size(); k++)
+	{
+		const CompiledSphereSet& set = compiled.sphereSets[k];
+		sets[k].material = set.material;
+		sets[k].count = set.x.size();
+		sets[k].numNodes = set.nodes.size();
+		sets[k].xOffset = writer.write(set.x);
+		sets[k].yOffset = writer.write(set.y);
+		sets[k].zOffset = writer.write(set.z);
+		sets[k].radiusOffset = writer.write(set.radius);
+		sets[k].nodesOffset = writer.write(set.nodes);
+	}
+
+	std::vector<BinaryMesh> meshes(compiled.meshes.size());
+	for(std::size_t k = 0; k < meshes.size(); k++)
+	{
+		const CompiledMesh& mesh = compiled.meshes[k];
+		meshes[k].material = mesh.material;
+		meshes[k].numVertices = mesh.vertices.size() / 3;
+		meshes[k].numTriangles = mesh.indices.size() / 3;
+		meshes[k].numNodes = mesh.nodes.size();
+		meshes[k].verticesOffset = writer.write(mesh.vertices);
+		meshes[k].indicesOffset = writer.write(mesh.indices);
+		meshes[k].nodesOffset = writer.write(mesh.nodes);
+	}
+
+	header.numSphereSets = sets.size();
+	header.sphereSetsOffset = writer.write(sets);
+	header.numMeshes = meshes.size();
+	header.meshesOffset = writer.write(meshes);
+	header.fileSize = writer.position;
+	header.contentHash = hashBytes(&header, sizeof(header), writer.hash);
+
+	bool ok = writer.ok && std::fseek(file, 0, SEEK_SET) == 0 &&
+	          std::fwrite(&header, sizeof(header), 1, file) == 1;
+	ok = (std::fclose(file) == 0) && ok;
+	if(!ok)
+	{
+		error = std::string("cannot write ") + path;
+		std::remove(path);
+	}
+	return ok;
+}
+
+bool isBinarySceneFile(const char *path)
+{
+	char magic[8];
+	FILE *file = std::fopen(path, "rb");
+	if(!file)
+		return false;
+	bool binary = std::fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+	              std::memcmp(magic, BINARY_SCENE_MAGIC, sizeof(magic)) == 0;
+	std::fclose(file);
+	return binary;
+}
+
+bool readBinarySceneHash(const char *path, uint64_t& hash)
+{
+	BinarySceneHeader header;
+	FILE *file = std::fopen(path, "rb");
+	if(!file)
+		return false;
+	bool ok = std::fread(&header, sizeof(header), 1, file) == 1 &&
+	          std::memcmp(header.magic, BINARY_SCENE_MAGIC, sizeof(header.magic)) == 0 &&
+	          header.version == BINARY_SCENE_VERSION && header.byteOrder == BINARY_SCENE_BYTE_ORDER;
+	std::fclose(file);
+	if(ok)
+		hash = header.contentHash;
+	return ok;
+}
+
+// Checks that the hierarchy is laid out depth first the way traverseBVH walks it, within its
+// stack, and that its leaves cover primitives that exist
+static bool validHierarchy(const BVHNode *nodes, uint32_t numNodes, uint64_t numPrimitives)
+{
+	int stack[BVH_MAX_DEPTH];
+	int top = 0;
+	uint32_t visited = 0;
+	for(uint32_t node = 0;;)
+	{
+		if(node != visited++ || node >= numNodes)
+			return false;
+		const BVHNode& n = nodes[node];
+		if(n.count == 0)
+		{
+			if(top == BVH_MAX_DEPTH || n.first < 0)
+				return false;
+			stack[top++] = n.first;
+			node++;
+			continue;
+		}
+		if(n.count < 0 || n.first < 0 || uint64_t(n.count) > numPrimitives || uint64_t(n.first) > numPrimitives - n.count)
+			return false;
+		if(top == 0)
+			return visited == numNodes;
+		node = stack[--top];
+	}
+}
+
+static bool validIndices(const int *indices, uint64_t count, uint64_t numVertices)
+{
+	for(uint64_t k = 0; k < count; k++)
+		if(indices[k] < 0 || uint64_t(indices[k]) >= numVertices)
+			return false;
+	return true;
+}
+
+bool BinaryScene::open(const char *path, std::string& error, std::size_t memoryBudget)
+{
+	header = NULL;
+	if(!file.open(path, error))
+		return false;
+
+	const BinarySceneHeader *h = section<BinarySceneHeader>(0, 1);
+	if(!h || std::memcmp(h->magic, BINARY_SCENE_MAGIC, sizeof(h->magic)) != 0)
+	{
+		error = std::string(path) + " is not a compiled scene";
+		return false;
+	}
+	if(h->version != BINARY_SCENE_VERSION || h->byteOrder != BINARY_SCENE_BYTE_ORDER || h->fileSize != file.getSize())
+	{
+		error = std::string(path) + " has an unsupported version or byte order, or is truncated";
+		return false;
+	}
+
+	std::string corrupt = std::string(path) + " is corrupt";
+	// The hierarchies and indices are read once, front to back, to check that rendering cannot
+	// leave the mapping
+	file.advise(0, file.getSize(), MappedFile::ACCESS_SEQUENTIAL);
+	const BinarySphereSet *sets = section<BinarySphereSet>(h->sphereSetsOffset, h->numSphereSets);
+	const BinaryMesh *meshes = section<BinaryMesh>(h->meshesOffset, h->numMeshes);
+	const SceneSphere *spheres = section<SceneSphere>(h->transformedSpheresOffset, h->numTransformedSpheres);
+	const SceneTriangle *triangles = section<SceneTriangle>(h->transformedTrianglesOffset, h->numTransformedTriangles);
+	if(!section<SceneMaterial>(h->materialsOffset, h->numMaterials) || !section<SceneLight>(h->lightsOffset, h->numLights) ||
+	   !section<TransformMatrix>(h->transformsOffset, h->numTransforms) || !sets || !meshes || !spheres || !triangles)
+	{
+		error = corrupt;
+		return false;
+	}
+
+	for(uint32_t k = 0; k < h->numSphereSets; k++)
+	{
+		const BinarySphereSet& s = sets[k];
+		if(s.material < 0 || uint32_t(s.material) >= h->numMaterials || s.count == 0 || s.numNodes == 0 ||
+		   !section<float>(s.xOffset, s.count) || !section<float>(s.yOffset, s.count) ||
+		   !section<float>(s.zOffset, s.count) || !section<float>(s.radiusOffset, s.count) ||
+		   !section<BVHNode>(s.nodesOffset, s.numNodes) ||
+		   !validHierarchy(section<BVHNode>(s.nodesOffset, s.numNodes), s.numNodes, s.count))
+		{
+			error = corrupt;
+			return false;
+		}
+	}
+	for(uint32_t k = 0; k < h->numMeshes; k++)
+	{
+		const BinaryMesh& m = meshes[k];
+		if(m.material < 0 || uint32_t(m.material) >= h->numMaterials || m.numTriangles == 0 || m.numNodes == 0 ||
+		   m.numTriangles > UINT64_MAX / 3 || m.numVertices > UINT64_MAX / 3 ||
+		   !section<float>(m.verticesOffset, m.numVertices * 3) ||
+		   !section<int>(m.indicesOffset, m.numTriangles * 3) || !section<BVHNode>(m.nodesOffset, m.numNodes) ||
+		   !validHierarchy(section<BVHNode>(m.nodesOffset, m.numNodes), m.numNodes, m.numTriangles) ||
+		   !validIndices(section<int>(m.indicesOffset, m.numTriangles * 3), m.numTriangles * 3, m.numVertices))
+		{
+			error = corrupt;
+			return false;
+		}
+	}
+	for(uint32_t k = 0; k < h->numTransformedSpheres; k++)
+		if(spheres[k].material < 0 || uint32_t(spheres[k].material) >= h->numMaterials ||
+		   spheres[k].transform < 0 || uint32_t(spheres[k].transform) >= h->numTransforms)
+		{
+			error = corrupt;
+			return false;
+		}
+	for(uint32_t k = 0; k < h->numTransformedTriangles; k++)
+		if(triangles[k].material < 0 || uint32_t(triangles[k].material) >= h->numMaterials ||
+		   triangles[k].transform < 0 || uint32_t(triangles[k].transform) >= h->numTransforms)
+		{
+			error = corrupt;
+			return false;
+		}
+
+	if(memoryBudget == 0)
+		memoryBudget = physicalMemory() / 2;
+	outOfCore = memoryBudget > 0 && file.getSize() > memoryBudget;
+	if(!outOfCore)
+	{
+		// Start reading the geometry in while the world is set up
+		file.prefetch(0, file.getSize());
+	}
+	else
+	{
+		// Every ray starts at the roots of the hierarchies, so they are worth holding on to.
+		// The geometry comes in a page at a time; readahead would mostly evict useful pages.
+		file.advise(0, file.getSize(), MappedFile::ACCESS_RANDOM);
+		std::size_t prefetched = 0;
+		for(uint32_t k = 0; k < h->numSphereSets && prefetched < memoryBudget / 2; k++)
+		{
+			file.prefetch(sets[k].nodesOffset, sets[k].numNodes * sizeof(BVHNode));
+			prefetched += sets[k].numNodes * sizeof(BVHNode);
+		}
+		for(uint32_t k = 0; k < h->numMeshes && prefetched < memoryBudget / 2; k++)
+		{
+			file.prefetch(meshes[k].nodesOffset, meshes[k].numNodes * sizeof(BVHNode));
+			prefetched += meshes[k].numNodes * sizeof(BVHNode);
+		}
+	}
+	header = h;
+	return true;
+}
+
+Camera* BinaryScene::createCamera(int image_width, int image_height, int samplesPerPixel) const
+{
+	const BinarySceneHeader *h = header;
+	Vector3D position(h->cameraPosition[0], h->cameraPosition[1], h->cameraPosition[2]);
+	Vector3D target(h->cameraTarget[0], h->cameraTarget[1], h->cameraTarget[2]);
+	Vector3D up(h->cameraUp[0], h->cameraUp[1], h->cameraUp[2]);
+	return new Camera(position, target, up, h->cameraFovY, image_width, image_height, samplesPerPixel);
+}
+
+World* BinaryScene::buildWorld(Camera *camera, bool depthMap, bool compressMeshes) const
+{
+	const BinarySceneHeader *h = header;
+	World *world = createWorld(h->background, depthMap);
+	std::vector<Material*> materials = createMaterials(world, camera, section<SceneMaterial>(h->materialsOffset, h->numMaterials),
+	                                                   h->numMaterials, depthMap);
+	addLights(world, section<SceneLight>(h->lightsOffset, h->numLights), h->numLights);
+
+	const BinarySphereSet *sets = section<BinarySphereSet>(h->sphereSetsOffset, h->numSphereSets);
+	for(uint32_t k = 0; k < h->numSphereSets; k++)
+	{
+		const BinarySphereSet& s = sets[k];
+		world->addObject(new SphereSet(s.count, section<float>(s.xOffset, s.count), section<float>(s.yOffset, s.count),
+		                               section<float>(s.zOffset, s.count), section<float>(s.radiusOffset, s.count),
+		                               section<BVHNode>(s.nodesOffset, s.numNodes), materials[s.material], camera));
+	}
+
+	const BinaryMesh *meshes = section<BinaryMesh>(h->meshesOffset, h->numMeshes);
+	for(uint32_t k = 0; k < h->numMeshes; k++)
+	{
+		const BinaryMesh& m = meshes[k];
+		world->addObject(createMesh(m.numVertices, section<float>(m.verticesOffset, m.numVertices * 3),
+		                            m.numTriangles, section<int>(m.indicesOffset, m.numTriangles * 3),
+		                            section<BVHNode>(m.nodesOffset, m.numNodes), m.numNodes, materials[m.material], camera,
+		                            compressMeshes));
+	}
+
+	addTransformedPrimitives(world, camera, materials,
+	                         section<TransformMatrix>(h->transformsOffset, h->numTransforms), h->numTransforms,
+	                         section<SceneSphere>(h->transformedSpheresOffset, h->numTransformedSpheres), h->numTransformedSpheres,
+	                         section<SceneTriangle>(h->transformedTrianglesOffset, h->numTransformedTriangles), h->numTransformedTriangles);
+	return world;
+}
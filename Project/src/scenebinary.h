@@ -0,0 +1,104 @@
+//scenebinary.h
+#ifndef _SCENEBINARY_H_
+#define _SCENEBINARY_H_
+
+#include <stdint.h>
+#include <string>
+#include "scenefile.h"
+#include "mappedfile.h"
+
+// Compiled scene container. The file is a header followed by sections at 64-byte aligned
+// offsets, all little endian:
+//   materials, lights, transforms                  SceneMaterial, SceneLight, TransformMatrix
+//   transformed spheres and triangles              SceneSphere, SceneTriangle
+//   sphere set and mesh tables                     BinarySphereSet, BinaryMesh
+//   the arrays those tables point to               SoA floats, int indices, BVH nodes
+// The arrays are the CompiledScene's, already in BVH order, so loading is a mapping and a
+// handful of object constructors no matter how large the scene is.
+#define BINARY_SCENE_MAGIC "LUMSCENE"
+#define BINARY_SCENE_VERSION 2
+#define BINARY_SCENE_ALIGNMENT 64
+
+struct BinarySceneHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder; // 0x01020304 as written by the compiler
+	float cameraPosition[3], cameraTarget[3], cameraUp[3];
+	float cameraFovY;
+	float background[3];
+	uint32_t numMaterials, numLights, numTransforms;
+	uint32_t numTransformedSpheres, numTransformedTriangles;
+	uint32_t numSphereSets, numMeshes;
+	uint32_t reserved;
+	uint64_t materialsOffset, lightsOffset, transformsOffset;
+	uint64_t transformedSpheresOffset, transformedTrianglesOffset;
+	uint64_t sphereSetsOffset, meshesOffset;
+	uint64_t numPrimitives;
+	uint64_t fileSize;
+	uint64_t contentHash; // FNV-1a of the sections, then of this header with contentHash 0
+};
+
+struct BinarySphereSet
+{
+	int32_t material;
+	uint32_t numNodes;
+	uint64_t count;
+	uint64_t xOffset, yOffset, zOffset, radiusOffset;
+	uint64_t nodesOffset;
+};
+
+struct BinaryMesh
+{
+	int32_t material;
+	uint32_t numNodes;
+	uint64_t numVertices, numTriangles;
+	uint64_t verticesOffset, indicesOffset;
+	uint64_t nodesOffset;
+};
+
+// Writes a scene compiled with compileScene
+bool writeBinaryScene(const char *path, const SceneDescription& scene, const CompiledScene& compiled, std::string& error);
+
+// True if the file starts with the compiled scene magic
+bool isBinarySceneFile(const char *path);
+// Reads the content hash from the header of a compiled scene of this version. Returns false
+// for any other file.
+bool readBinarySceneHash(const char *path, uint64_t& hash);
+
+// A mapped compiled scene. The objects of a world built from it point into the mapping, so
+// the BinaryScene must outlive the world. Opening validates the header, the section tables,
+// the BVH links and leaf ranges and the mesh indices; vertex and sphere data are not read
+// before rendering.
+class BinaryScene
+{
+private:
+	MappedFile file;
+	const BinarySceneHeader *header;
+	bool outOfCore;
+
+	template<typename T>
+	const T* section(uint64_t offset, uint64_t count) const
+	{
+		if(offset % alignof(T) != 0 || offset > file.getSize() || count > (file.getSize() - offset) / sizeof(T))
+			return NULL;
+		return reinterpret_cast<const T*>(file.getData() + offset);
+	}
+
+public:
+	BinaryScene(): header(NULL), outOfCore(false) {}
+
+	// A file larger than memoryBudget (default half of physical memory) is rendered out of core:
+	// instead of reading it all in up front, pages are faulted in as rays reach them, without
+	// readahead, and only the BVH nodes are prefetched, as far as half the budget allows.
+	// Validation still reads the nodes and indices once.
+	bool open(const char *path, std::string& error, std::size_t memoryBudget = 0);
+	std::size_t getNumPrimitives() const {return header ? header->numPrimitives : 0;}
+	bool isOutOfCore() const {return outOfCore;}
+
+	Camera* createCamera(int image_width, int image_height, int samplesPerPixel) const;
+	// Compressed meshes are copies; without compression the world reads the mapping
+	World* buildWorld(Camera *camera, bool depthMap, bool compressMeshes = false) const;
+};
+
+#endif
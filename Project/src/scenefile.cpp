@@ -0,0 +1,653 @@
+//scenefile.cpp
+
+#include "scenefile.h"
+#include "scenes.h"
+#include "sphere.h"
+#include "triangle.h"
+#include "transformedSurface.h"
+#include "pointlightsource.h"
+#include "sphereset.h"
+#include "trianglemesh.h"
+#include "compressedmesh.h"
+#include "objloader.h"
+#include "plyloader.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <float.h>
+
+SceneDescription::SceneDescription() : cameraFovY(45)
+{
+	cameraPosition[0] = 0; cameraPosition[1] = 0; cameraPosition[2] = 10;
+	cameraTarget[0] = 0; cameraTarget[1] = 0; cameraTarget[2] = 0;
+	cameraUp[0] = 0; cameraUp[1] = 1; cameraUp[2] = 0;
+	background[0] = 0.53f; background[1] = 0.81f; background[2] = 0.92f;
+}
+
+std::size_t SceneDescription::getNumPrimitives() const
+{
+	std::size_t n = spheres.size() + triangles.size();
+	for(std::size_t m = 0; m < meshes.size(); m++)
+		n += meshes[m].numTriangles;
+	return n;
+}
+
+static bool isWord(const char *w, std::size_t len, const char *keyword)
+{
+	return std::strlen(keyword) == len && std::memcmp(w, keyword, len) == 0;
+}
+
+// Cursor over the whole file. Tokens are read in place and numbers are converted with
+// from_chars, so the only allocations are the growth of the description's arrays.
+struct SceneParser
+{
+	const char *p, *end;
+	int line;
+	std::string directory; // Of the scene file, for the paths of imported files
+	std::string error;
+
+	bool fail(const std::string& message)
+	{
+		error = "line " + std::to_string(line) + ": " + message;
+		return false;
+	}
+
+	// Skips blanks and comments. Stops at a newline unless crossLines is set.
+	void skipSpace(bool crossLines)
+	{
+		while(p < end)
+		{
+			char c = *p;
+			if(c == ' ' || c == '\t' || c == '\r')
+				p++;
+			else if(c == '#')
+				while(p < end && *p != '\n')
+					p++;
+			else if(c == '\n' && crossLines)
+			{
+				line++;
+				p++;
+			}
+			else
+				return;
+		}
+	}
+
+	bool atLineEnd()
+	{
+		skipSpace(false);
+		return p == end || *p == '\n';
+	}
+
+	bool word(const char *&w, std::size_t& len)
+	{
+		skipSpace(false);
+		w = p;
+		while(p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' && *p != '#')
+			p++;
+		len = p - w;
+		return len > 0 || fail("unexpected end of line");
+	}
+
+	template<typename T>
+	bool number(T& value, bool crossLines = false)
+	{
+		skipSpace(crossLines);
+		std::from_chars_result r = std::from_chars(p, end, value);
+		if(r.ec != std::errc())
+			return fail("expected a number");
+		p = r.ptr;
+		return true;
+	}
+
+	bool numbers(float *values, int count)
+	{
+		for(int k = 0; k < count; k++)
+			if(!number(values[k]))
+				return false;
+		return true;
+	}
+
+	// Looks a name up in a small table. Consecutive primitives usually share a material,
+	// so the previous hit is tried first.
+	bool lookup(const std::vector<std::string>& names, int& last, int& index)
+	{
+		const char *w;
+		std::size_t len;
+		if(!word(w, len))
+			return false;
+		if(last >= 0 && isWord(w, len, names[last].c_str()))
+		{
+			index = last;
+			return true;
+		}
+		for(std::size_t k = 0; k < names.size(); k++)
+			if(isWord(w, len, names[k].c_str()))
+			{
+				index = last = (int)k;
+				return true;
+			}
+		return fail("undefined name '" + std::string(w, len) + "'");
+	}
+
+	// Optional "transform name" at the end of a primitive's line
+	bool optionalTransform(const SceneDescription& scene, int& lastTransform, int& transform)
+	{
+		transform = -1;
+		if(atLineEnd())
+			return true;
+		const char *w;
+		std::size_t len;
+		word(w, len);
+		if(!isWord(w, len, "transform"))
+			return fail("expected 'transform' or end of line");
+		return lookup(scene.transformNames, lastTransform, transform);
+	}
+
+	bool newName(const std::vector<std::string>& names, std::string& name)
+	{
+		const char *w;
+		std::size_t len;
+		if(!word(w, len))
+			return false;
+		name.assign(w, len);
+		for(std::size_t k = 0; k < names.size(); k++)
+			if(names[k] == name)
+				return fail("'" + name + "' is already defined");
+		return true;
+	}
+
+	bool parseTransform(SceneDescription& scene)
+	{
+		std::string name;
+		if(!newName(scene.transformNames, name))
+			return false;
+		TransformMatrix m;
+		while(!atLineEnd())
+		{
+			const char *w;
+			std::size_t len;
+			word(w, len);
+			float a[3];
+			if(isWord(w, len, "translate") && numbers(a, 3))
+				m = m * m.Translation(a[0], a[1], a[2]);
+			else if(isWord(w, len, "scale") && numbers(a, 3))
+				m = m * m.Scaling(a[0], a[1], a[2]);
+			else if(isWord(w, len, "rotatex") && number(a[0]))
+				m = m * m.RotationX(a[0]);
+			else if(isWord(w, len, "rotatey") && number(a[0]))
+				m = m * m.RotationY(a[0]);
+			else if(isWord(w, len, "rotatez") && number(a[0]))
+				m = m * m.RotationZ(a[0]);
+			else
+				return error.empty() ? fail("unknown transform '" + std::string(w, len) + "'") : false;
+		}
+		scene.transformNames.push_back(name);
+		scene.transforms.push_back(m);
+		return true;
+	}
+
+	bool parseMesh(SceneDescription& scene, int& lastMaterial, int& lastTransform)
+	{
+		SceneMesh mesh;
+		if(!lookup(scene.materialNames, lastMaterial, mesh.material) ||
+		   !number(mesh.numVertices) || !number(mesh.numTriangles) ||
+		   !optionalTransform(scene, lastTransform, mesh.transform))
+			return false;
+		int meshLine = line;
+
+		mesh.firstVertex = scene.vertices.size() / 3;
+		mesh.firstIndex = scene.indices.size();
+		scene.vertices.resize(scene.vertices.size() + mesh.numVertices * 3);
+		scene.indices.resize(scene.indices.size() + mesh.numTriangles * 3);
+
+		float *v = scene.vertices.data() + mesh.firstVertex * 3;
+		for(std::size_t k = 0; k < mesh.numVertices * 3; k++)
+			if(!number(v[k], true))
+				return false;
+
+		int *idx = scene.indices.data() + mesh.firstIndex;
+		for(std::size_t k = 0; k < mesh.numTriangles * 3; k++)
+		{
+			if(!number(idx[k], true))
+				return false;
+			if(idx[k] < 0 || std::size_t(idx[k]) >= mesh.numVertices)
+				return fail("vertex index out of range for the mesh on line " + std::to_string(meshLine));
+		}
+		scene.meshes.push_back(mesh);
+		return true;
+	}
+
+	bool filePath(std::string& path)
+	{
+		const char *w;
+		std::size_t len;
+		if(!word(w, len))
+			return false;
+		path.assign(w, len);
+		if(path[0] != '/')
+			path = directory + path;
+		return true;
+	}
+
+	bool parseOBJ(SceneDescription& scene, int& lastTransform)
+	{
+		std::string path, importError;
+		int transform;
+		if(!filePath(path) || !optionalTransform(scene, lastTransform, transform))
+			return false;
+		if(!importOBJ(path.c_str(), scene, transform, 0, importError))
+			return fail(importError);
+		return true;
+	}
+
+	bool parsePLY(SceneDescription& scene, int& lastMaterial, int& lastTransform)
+	{
+		std::string path, importError;
+		int material, transform;
+		if(!lookup(scene.materialNames, lastMaterial, material) || !filePath(path) ||
+		   !optionalTransform(scene, lastTransform, transform))
+			return false;
+		if(!importPLY(path.c_str(), scene, material, transform, importError))
+			return fail(importError);
+		return true;
+	}
+
+	bool parse(SceneDescription& scene)
+	{
+		int lastMaterial = -1, lastTransform = -1;
+		for(;;)
+		{
+			skipSpace(true);
+			if(p == end)
+				return true;
+
+			const char *w;
+			std::size_t len;
+			word(w, len);
+			bool ok;
+			// Most frequent commands first
+			if(isWord(w, len, "sphere"))
+			{
+				SceneSphere s;
+				ok = lookup(scene.materialNames, lastMaterial, s.material) && numbers(s.center, 3) &&
+				     number(s.radius) && optionalTransform(scene, lastTransform, s.transform);
+				if(ok)
+					scene.spheres.push_back(s);
+			}
+			else if(isWord(w, len, "triangle"))
+			{
+				SceneTriangle t;
+				ok = lookup(scene.materialNames, lastMaterial, t.material) && numbers(t.vertices, 9) &&
+				     optionalTransform(scene, lastTransform, t.transform);
+				if(ok)
+					scene.triangles.push_back(t);
+			}
+			else if(isWord(w, len, "mesh"))
+				ok = parseMesh(scene, lastMaterial, lastTransform);
+			else if(isWord(w, len, "obj"))
+				ok = parseOBJ(scene, lastTransform);
+			else if(isWord(w, len, "ply"))
+				ok = parsePLY(scene, lastMaterial, lastTransform);
+			else if(isWord(w, len, "material"))
+			{
+				std::string name;
+				SceneMaterial m;
+				ok = newName(scene.materialNames, name) && numbers(m.color, 3) &&
+				     number(m.ka) && number(m.kd) && number(m.ks) && number(m.kr) &&
+				     number(m.kt) && number(m.eta) && number(m.C) && number(m.n);
+				if(ok)
+				{
+					scene.materialNames.push_back(name);
+					scene.materials.push_back(m);
+				}
+			}
+			else if(isWord(w, len, "transform"))
+				ok = parseTransform(scene);
+			else if(isWord(w, len, "light"))
+			{
+				SceneLight l;
+				ok = numbers(l.position, 3) && numbers(l.color, 3);
+				if(ok)
+					scene.lights.push_back(l);
+			}
+			else if(isWord(w, len, "camera"))
+				ok = numbers(scene.cameraPosition, 3) && numbers(scene.cameraTarget, 3) &&
+				     numbers(scene.cameraUp, 3) && number(scene.cameraFovY);
+			else if(isWord(w, len, "background"))
+				ok = numbers(scene.background, 3);
+			else
+				return fail("unknown command '" + std::string(w, len) + "'");
+
+			if(!ok)
+				return false;
+			if(!atLineEnd())
+				return fail("unexpected text after '" + std::string(w, len) + "'");
+		}
+	}
+};
+
+bool parseSceneFile(const char *path, SceneDescription& scene, std::string& error)
+{
+	FILE *file = std::fopen(path, "rb");
+	if(!file)
+	{
+		error = std::string("cannot open ") + path;
+		return false;
+	}
+	std::fseek(file, 0, SEEK_END);
+	long size = std::ftell(file);
+	std::fseek(file, 0, SEEK_SET);
+
+	// One read of the whole file; the parser works on it in place
+	std::vector<char> buffer(size > 0 ? size : 1);
+	std::size_t read = size > 0 ? std::fread(buffer.data(), 1, size, file) : 0;
+	std::fclose(file);
+	if(read != std::size_t(size > 0 ? size : 0))
+	{
+		error = std::string("cannot read ") + path;
+		return false;
+	}
+
+	SceneParser parser;
+	parser.p = buffer.data();
+	parser.end = buffer.data() + read;
+	parser.line = 1;
+	const char *slash = std::strrchr(path, '/');
+	if(slash)
+		parser.directory.assign(path, slash + 1);
+	if(!parser.parse(scene))
+	{
+		error = std::string(path) + ", " + parser.error;
+		return false;
+	}
+	return true;
+}
+
+Camera* createCamera(const SceneDescription& scene, int image_width, int image_height, int samplesPerPixel)
+{
+	Vector3D position(scene.cameraPosition[0], scene.cameraPosition[1], scene.cameraPosition[2]);
+	Vector3D target(scene.cameraTarget[0], scene.cameraTarget[1], scene.cameraTarget[2]);
+	Vector3D up(scene.cameraUp[0], scene.cameraUp[1], scene.cameraUp[2]);
+	return new Camera(position, target, up, scene.cameraFovY, image_width, image_height, samplesPerPixel);
+}
+
+static Vector3D toVector(const float *v)
+{
+	return Vector3D(v[0], v[1], v[2]);
+}
+
+static void addVertexBox(float *box, const float *v)
+{
+	for(int a = 0; a < 3; a++)
+	{
+		box[a] = std::min(box[a], v[a]);
+		box[a + 3] = std::max(box[a + 3], v[a]);
+	}
+}
+
+// Reorders the mesh's triangles into BVH leaf order and its vertices into order of first use,
+// so a subtree's triangles and vertices both sit on a few contiguous pages of a compiled scene
+static void finishMesh(CompiledMesh& mesh)
+{
+	std::size_t numTriangles = mesh.indices.size() / 3;
+	std::vector<float> boxes(numTriangles * 6);
+	for(std::size_t t = 0; t < numTriangles; t++)
+	{
+		float *box = &boxes[t * 6];
+		box[0] = box[1] = box[2] = FLT_MAX;
+		box[3] = box[4] = box[5] = -FLT_MAX;
+		for(int c = 0; c < 3; c++)
+			addVertexBox(box, &mesh.vertices[mesh.indices[t*3 + c] * std::size_t(3)]);
+	}
+
+	std::vector<unsigned> order;
+	buildBVH(boxes.data(), numTriangles, mesh.nodes, order);
+	std::vector<int> sorted(mesh.indices.size());
+	for(std::size_t t = 0; t < numTriangles; t++)
+		for(int c = 0; c < 3; c++)
+			sorted[t*3 + c] = mesh.indices[order[t] * std::size_t(3) + c];
+	mesh.indices.swap(sorted);
+	sorted = std::vector<int>();
+
+	// Vertices no triangle uses are dropped on the way
+	std::vector<int> remap(mesh.vertices.size() / 3, -1);
+	std::vector<float> vertices;
+	vertices.reserve(mesh.vertices.size());
+	for(std::size_t k = 0; k < mesh.indices.size(); k++)
+	{
+		int& v = remap[mesh.indices[k]];
+		if(v < 0)
+		{
+			v = (int)(vertices.size() / 3);
+			vertices.insert(vertices.end(), &mesh.vertices[mesh.indices[k] * std::size_t(3)], &mesh.vertices[mesh.indices[k] * std::size_t(3)] + 3);
+		}
+		mesh.indices[k] = v;
+	}
+	mesh.vertices.swap(vertices);
+}
+
+void compileScene(const SceneDescription& scene, CompiledScene& compiled)
+{
+	const std::size_t numMaterials = scene.materials.size();
+
+	// Untransformed spheres, one set per material
+	std::vector<std::vector<std::size_t> > spheresByMaterial(numMaterials);
+	for(std::size_t k = 0; k < scene.spheres.size(); k++)
+	{
+		if(scene.spheres[k].transform >= 0)
+			compiled.transformedSpheres.push_back(scene.spheres[k]);
+		else
+			spheresByMaterial[scene.spheres[k].material].push_back(k);
+	}
+	for(std::size_t m = 0; m < numMaterials; m++)
+	{
+		const std::vector<std::size_t>& members = spheresByMaterial[m];
+		if(members.empty())
+			continue;
+		std::vector<float> boxes(members.size() * 6);
+		for(std::size_t k = 0; k < members.size(); k++)
+		{
+			const SceneSphere& s = scene.spheres[members[k]];
+			for(int a = 0; a < 3; a++)
+			{
+				boxes[k*6 + a] = s.center[a] - s.radius;
+				boxes[k*6 + a + 3] = s.center[a] + s.radius;
+			}
+		}
+
+		compiled.sphereSets.push_back(CompiledSphereSet());
+		CompiledSphereSet& set = compiled.sphereSets.back();
+		set.material = (int)m;
+		std::vector<unsigned> order;
+		buildBVH(boxes.data(), members.size(), set.nodes, order);
+		set.x.resize(members.size());
+		set.y.resize(members.size());
+		set.z.resize(members.size());
+		set.radius.resize(members.size());
+		for(std::size_t k = 0; k < members.size(); k++)
+		{
+			const SceneSphere& s = scene.spheres[members[order[k]]];
+			set.x[k] = s.center[0];
+			set.y[k] = s.center[1];
+			set.z[k] = s.center[2];
+			set.radius[k] = s.radius;
+		}
+	}
+
+	// Untransformed loose triangles, one unshared-vertex mesh per material
+	std::vector<int> meshOfMaterial(numMaterials, -1);
+	for(std::size_t k = 0; k < scene.triangles.size(); k++)
+	{
+		const SceneTriangle& t = scene.triangles[k];
+		if(t.transform >= 0)
+		{
+			compiled.transformedTriangles.push_back(t);
+			continue;
+		}
+		if(meshOfMaterial[t.material] < 0)
+		{
+			meshOfMaterial[t.material] = (int)compiled.meshes.size();
+			compiled.meshes.push_back(CompiledMesh());
+			compiled.meshes.back().material = t.material;
+		}
+		CompiledMesh& mesh = compiled.meshes[meshOfMaterial[t.material]];
+		int first = (int)(mesh.vertices.size() / 3);
+		mesh.vertices.insert(mesh.vertices.end(), t.vertices, t.vertices + 9);
+		for(int c = 0; c < 3; c++)
+			mesh.indices.push_back(first + c);
+	}
+
+	// Indexed meshes, with their transform applied to the vertices. Meshes may share a vertex range,
+	// as an OBJ file's materials do, so each only copies the vertices its triangles use. remap is
+	// shared by all meshes and reset entry by entry, keeping the work proportional to the indices.
+	std::vector<int> remap;
+	for(std::size_t k = 0; k < scene.meshes.size(); k++)
+	{
+		const SceneMesh& sceneMesh = scene.meshes[k];
+		if(sceneMesh.numTriangles == 0)
+			continue;
+		compiled.meshes.push_back(CompiledMesh());
+		CompiledMesh& mesh = compiled.meshes.back();
+		mesh.material = sceneMesh.material;
+		const float *v = scene.vertices.data() + sceneMesh.firstVertex * 3;
+		const int *idx = scene.indices.data() + sceneMesh.firstIndex;
+		if(remap.size() < sceneMesh.numVertices)
+			remap.resize(sceneMesh.numVertices, -1);
+		mesh.indices.resize(sceneMesh.numTriangles * 3);
+		for(std::size_t i = 0; i < mesh.indices.size(); i++)
+		{
+			int& used = remap[idx[i]];
+			if(used < 0)
+			{
+				used = (int)(mesh.vertices.size() / 3);
+				mesh.vertices.insert(mesh.vertices.end(), v + idx[i] * std::size_t(3), v + idx[i] * std::size_t(3) + 3);
+			}
+			mesh.indices[i] = used;
+		}
+		for(std::size_t i = 0; i < mesh.indices.size(); i++)
+			remap[idx[i]] = -1;
+		if(sceneMesh.transform >= 0)
+		{
+			const TransformMatrix& m = scene.transforms[sceneMesh.transform];
+			for(std::size_t i = 0; i < mesh.vertices.size() / 3; i++)
+			{
+				Vector3D p = m * Vector3D(mesh.vertices[i*3], mesh.vertices[i*3 + 1], mesh.vertices[i*3 + 2]);
+				mesh.vertices[i*3 + 0] = p.X();
+				mesh.vertices[i*3 + 1] = p.Y();
+				mesh.vertices[i*3 + 2] = p.Z();
+			}
+		}
+	}
+
+	for(std::size_t k = 0; k < compiled.meshes.size(); k++)
+		finishMesh(compiled.meshes[k]);
+}
+
+World* createWorld(const float background[3], bool depthMap)
+{
+	World *world = new World;
+	world->setAmbient(Color(1));
+	if(!depthMap)
+		world->setBackground(Color(background[0], background[1], background[2]));
+	else
+		world->setBackground(Color(0.0, 0.0, 0.0));
+	return world;
+}
+
+std::vector<Material*> createMaterials(World *world, Camera *camera, const SceneMaterial *materials, std::size_t count, bool depthMap)
+{
+	std::vector<Material*> result(count);
+	for(std::size_t k = 0; k < count; k++)
+	{
+		const SceneMaterial& m = materials[k];
+		result[k] = assignMaterial(world, camera, Color(m.color[0], m.color[1], m.color[2]),
+		                           m.ka, m.kd, m.ks, m.kr, m.kt, m.eta, m.C, m.n, depthMap);
+	}
+	return result;
+}
+
+void addLights(World *world, const SceneLight *lights, std::size_t count)
+{
+	for(std::size_t k = 0; k < count; k++)
+	{
+		const SceneLight& l = lights[k];
+		world->addLight(new PointLightSource(world, toVector(l.position), Color(l.color[0], l.color[1], l.color[2])));
+	}
+}
+
+void addTransformedPrimitives(World *world, Camera *camera, const std::vector<Material*>& materials,
+                              const TransformMatrix *transforms, std::size_t numTransforms,
+                              const SceneSphere *spheres, std::size_t numSpheres,
+                              const SceneTriangle *triangles, std::size_t numTriangles)
+{
+	if(numSpheres + numTriangles == 0)
+		return;
+
+	// TransformedSurface keeps a pointer to its matrix
+	std::vector<TransformMatrix*> matrices(numTransforms);
+	for(std::size_t k = 0; k < numTransforms; k++)
+		matrices[k] = new TransformMatrix(transforms[k]);
+
+	for(std::size_t k = 0; k < numSpheres; k++)
+	{
+		const SceneSphere& s = spheres[k];
+		Material *mat = materials[s.material];
+		Object *sphere = new Sphere(toVector(s.center), s.radius, mat, camera);
+		world->addObject(new TransformedSurface(sphere, matrices[s.transform], mat, camera));
+	}
+
+	for(std::size_t k = 0; k < numTriangles; k++)
+	{
+		const SceneTriangle& t = triangles[k];
+		Material *mat = materials[t.material];
+		Object *triangle = new Triangle(toVector(t.vertices), toVector(t.vertices + 3), toVector(t.vertices + 6), mat, camera);
+		world->addObject(new TransformedSurface(triangle, matrices[t.transform], mat, camera));
+	}
+}
+
+Object* createMesh(std::size_t numVertices, const float *vertices, std::size_t numTriangles, const int *indices,
+                   const BVHNode *nodes, std::size_t numNodes, Material *material, Camera *camera, bool compress)
+{
+	if(compress)
+		return new CompressedMesh(numVertices, vertices, numTriangles, indices, nodes, numNodes, material, camera);
+	return new TriangleMesh(numVertices, vertices, numTriangles, indices, nodes, numNodes, material, camera);
+}
+
+World* buildWorld(const SceneDescription& scene, Camera *camera, bool depthMap, bool compressMeshes)
+{
+	World *world = createWorld(scene.background, depthMap);
+	std::vector<Material*> materials = createMaterials(world, camera, scene.materials.data(), scene.materials.size(), depthMap);
+	addLights(world, scene.lights.data(), scene.lights.size());
+
+	// The objects point into the compiled arrays, which are never freed, like the objects themselves
+	CompiledScene *compiled = new CompiledScene;
+	compileScene(scene, *compiled);
+
+	for(std::size_t k = 0; k < compiled->sphereSets.size(); k++)
+	{
+		const CompiledSphereSet& set = compiled->sphereSets[k];
+		world->addObject(new SphereSet(set.x.size(), set.x.data(), set.y.data(), set.z.data(), set.radius.data(),
+		                               set.nodes.data(), materials[set.material], camera));
+	}
+	for(std::size_t k = 0; k < compiled->meshes.size(); k++)
+	{
+		CompiledMesh& mesh = compiled->meshes[k];
+		world->addObject(createMesh(mesh.vertices.size() / 3, mesh.vertices.data(), mesh.indices.size() / 3, mesh.indices.data(),
+		                            mesh.nodes.data(), mesh.nodes.size(), materials[mesh.material], camera, compressMeshes));
+		if(compressMeshes)
+		{
+			// The compressed mesh has its own copy
+			mesh.vertices = std::vector<float>();
+			mesh.indices = std::vector<int>();
+			mesh.nodes = std::vector<BVHNode>();
+		}
+	}
+
+	addTransformedPrimitives(world, camera, materials, scene.transforms.data(), scene.transforms.size(),
+	                         compiled->transformedSpheres.data(), compiled->transformedSpheres.size(),
+	                         compiled->transformedTriangles.data(), compiled->transformedTriangles.size());
+	return world;
+}
@@ -0,0 +1,141 @@
+//scenefile.h
+#ifndef _SCENEFILE_H_
+#define _SCENEFILE_H_
+
+#include <string>
+#include <vector>
+#include "world.h"
+#include "camera.h"
+#include "bvh.h"
+
+// Plain-text scene description, one command per line, '#' starts a comment:
+//
+//   camera     px py pz  tx ty tz  ux uy uz  fovy
+//   background r g b
+//   material   name  r g b  ka kd ks kr kt eta C n          (same order as assignMaterial)
+//   light      x y z  r g b                                  (point light)
+//   transform  name  op args [op args ...]                   (ops: translate x y z, scale x y z,
+//                                                              rotatex a, rotatey a, rotatez a)
+//   sphere     material  cx cy cz radius       [transform name]
+//   triangle   material  x0 y0 z0 x1 y1 z1 x2 y2 z2  [transform name]
+//   mesh       material  numVertices numTriangles [transform name]
+//              followed by numVertices * 3 coordinates and numTriangles * 3 zero-based indices
+//   obj        path  [transform name]                        (Wavefront OBJ, see objloader.h;
+//                                                              relative to the scene file)
+//   ply        material  path  [transform name]              (binary PLY, see plyloader.h)
+//
+// Transform ops compose left to right like the TransformMatrix products in scenes.cpp, and
+// angles are in radians as TransformMatrix expects. A transformed sphere or triangle becomes a
+// TransformedSurface; a transformed mesh has its vertices transformed once at build time.
+// Names must be defined before they are used. Objects are built in the order of
+// compileScene below, not in file order.
+
+struct SceneMaterial
+{
+	float color[3];
+	float ka, kd, ks, kr, kt, eta, C;
+	int n;
+};
+
+struct SceneLight
+{
+	float position[3];
+	float color[3];
+};
+
+struct SceneSphere
+{
+	float center[3];
+	float radius;
+	int material;
+	int transform; // -1 if none
+};
+
+struct SceneTriangle
+{
+	float vertices[9];
+	int material;
+	int transform;
+};
+
+// A range of SceneDescription::vertices and SceneDescription::indices
+struct SceneMesh
+{
+	int material;
+	int transform;
+	std::size_t firstVertex, numVertices;
+	std::size_t firstIndex, numTriangles;
+};
+
+struct SceneDescription
+{
+	float cameraPosition[3], cameraTarget[3], cameraUp[3];
+	float cameraFovY;
+	float background[3];
+
+	std::vector<std::string> materialNames;
+	std::vector<SceneMaterial> materials;
+	std::vector<std::string> transformNames;
+	std::vector<TransformMatrix> transforms;
+	std::vector<SceneLight> lights;
+	std::vector<SceneSphere> spheres;
+	std::vector<SceneTriangle> triangles;
+	std::vector<SceneMesh> meshes;
+	std::vector<float> vertices; // xyz of every mesh, back to back
+	std::vector<int> indices;    // Relative to the mesh's first vertex
+
+	SceneDescription(); // Defaults match the built-in scenes' camera and background
+	std::size_t getNumPrimitives() const;
+};
+
+// Geometry regrouped for rendering: untransformed spheres and loose triangles are gathered per
+// material into SphereSets and TriangleMeshes, every set and mesh gets a BVH, and primitives are
+// stored in BVH leaf order. Transformed spheres and triangles stay individual objects.
+struct CompiledSphereSet
+{
+	int material;
+	std::vector<float> x, y, z, radius;
+	std::vector<BVHNode> nodes;
+};
+
+struct CompiledMesh
+{
+	int material;
+	std::vector<float> vertices;
+	std::vector<int> indices;
+	std::vector<BVHNode> nodes;
+};
+
+struct CompiledScene
+{
+	std::vector<CompiledSphereSet> sphereSets;
+	std::vector<CompiledMesh> meshes;
+	std::vector<SceneSphere> transformedSpheres;
+	std::vector<SceneTriangle> transformedTriangles;
+};
+
+// Reads a whole scene file. Returns false and sets error (with the line number) on failure.
+bool parseSceneFile(const char *path, SceneDescription& scene, std::string& error);
+
+Camera* createCamera(const SceneDescription& scene, int image_width, int image_height, int samplesPerPixel);
+
+void compileScene(const SceneDescription& scene, CompiledScene& compiled);
+
+// Creates the world's materials, lights and objects. depthMap is passed on to every material
+// like buildScene does. The compiled geometry is kept for the lifetime of the program.
+// compressMeshes stores meshes as CompressedMesh instead of TriangleMesh.
+World* buildWorld(const SceneDescription& scene, Camera *camera, bool depthMap, bool compressMeshes = false);
+
+// Building blocks shared by the text and binary scene loaders
+World* createWorld(const float background[3], bool depthMap);
+std::vector<Material*> createMaterials(World *world, Camera *camera, const SceneMaterial *materials, std::size_t count, bool depthMap);
+void addLights(World *world, const SceneLight *lights, std::size_t count);
+// A TriangleMesh over the arrays, or a CompressedMesh made from them. Triangles are in BVH leaf order.
+Object* createMesh(std::size_t numVertices, const float *vertices, std::size_t numTriangles, const int *indices,
+                   const BVHNode *nodes, std::size_t numNodes, Material *material, Camera *camera, bool compress);
+void addTransformedPrimitives(World *world, Camera *camera, const std::vector<Material*>& materials,
+                              const TransformMatrix *transforms, std::size_t numTransforms,
+                              const SceneSphere *spheres, std::size_t numSpheres,
+                              const SceneTriangle *triangles, std::size_t numTriangles);
+
+#endif
@@ -0,0 +1,218 @@
+//sceneloader.cpp
+
+#include "sceneloader.h"
+#include "scenefile.h"
+#include "scenebinary.h"
+#include "objloader.h"
+#include "plyloader.h"
+#include "compressedmesh.h"
+#include "filepath.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <float.h>
+#include <new>
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// A mesh file on its own has no camera or lights: look at the mesh down -z from far enough
+// to see its whole bounding sphere, with a white light next to the camera
+static void frameMesh(SceneDescription& scene, const float lo[3], const float hi[3])
+{
+	if(lo[0] > hi[0])
+		return; // No vertices
+	float radius = 0.0f;
+	for(int a = 0; a < 3; a++)
+	{
+		scene.cameraTarget[a] = 0.5f * (lo[a] + hi[a]);
+		radius += (hi[a] - lo[a]) * (hi[a] - lo[a]);
+	}
+	radius = 0.5f * std::sqrt(radius);
+	float distance = 1.1f * radius / std::sin(0.5f * scene.cameraFovY * 3.14159265f / 180.0f);
+	scene.cameraPosition[0] = scene.cameraTarget[0];
+	scene.cameraPosition[1] = scene.cameraTarget[1];
+	scene.cameraPosition[2] = scene.cameraTarget[2] + distance;
+
+	SceneLight light = {{scene.cameraPosition[0] + radius, scene.cameraPosition[1] + radius, scene.cameraPosition[2]},
+	                    {1.0f, 1.0f, 1.0f}};
+	scene.lights.push_back(light);
+}
+
+static void sceneBounds(const SceneDescription& scene, float lo[3], float hi[3])
+{
+	lo[0] = lo[1] = lo[2] = FLT_MAX;
+	hi[0] = hi[1] = hi[2] = -FLT_MAX;
+	for(std::size_t k = 0; k < scene.vertices.size(); k += 3)
+		for(int a = 0; a < 3; a++)
+		{
+			lo[a] = std::min(lo[a], scene.vertices[k + a]);
+			hi[a] = std::max(hi[a], scene.vertices[k + a]);
+		}
+}
+
+// PLY files have no materials
+static const SceneMaterial plyMaterial = {{0.8f, 0.8f, 0.8f}, 0.25f, 0.75f, 0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 64};
+
+// Text description of a mesh file, for compiling it or when it cannot be used in place
+static bool importMeshScene(const char *path, SceneDescription& scene, std::string& error)
+{
+	bool ok;
+	if(hasExtension(path, ".ply"))
+	{
+		scene.materialNames.push_back("default");
+		scene.materials.push_back(plyMaterial);
+		ok = importPLY(path, scene, 0, -1, error);
+	}
+	else
+		ok = importOBJ(path, scene, -1, 0, error);
+	if(!ok)
+		return false;
+	float lo[3], hi[3];
+	sceneBounds(scene, lo, hi);
+	frameMesh(scene, lo, hi);
+	return true;
+}
+
+static bool isMeshFile(const char *path)
+{
+	return hasExtension(path, ".obj") || hasExtension(path, ".ply");
+}
+
+static std::size_t sceneMemoryBudget = 0;
+static bool compressMeshes = false;
+
+void setSceneMemoryBudget(std::size_t bytes)
+{
+	sceneMemoryBudget = bytes;
+}
+
+void setMeshCompression(bool compress)
+{
+	compressMeshes = compress;
+}
+
+static void addMeshStats(const World *world, SceneLoadStats& stats)
+{
+	stats.meshTriangles = stats.meshBytes = 0;
+	stats.meshError = 0.0f;
+	const std::vector<Object*>& objects = world->getObjectList();
+	for(std::size_t k = 0; k < objects.size(); k++)
+		if(objects[k]->getType() == Object::MESH)
+		{
+			const TriangleMesh *mesh = static_cast<const TriangleMesh*>(objects[k]);
+			stats.meshTriangles += mesh->getNumTriangles();
+			stats.meshBytes += mesh->getMemoryUsage();
+		}
+		else if(objects[k]->getType() == Object::COMPRESSED_MESH)
+		{
+			const CompressedMesh *mesh = static_cast<const CompressedMesh*>(objects[k]);
+			stats.meshTriangles += mesh->getNumTriangles();
+			stats.meshBytes += mesh->getMemoryUsage();
+			stats.meshError = std::max(stats.meshError, mesh->getMaxError());
+		}
+}
+
+static World* loadScene(const char *path, int image_width, int image_height, int samplesPerPixel, bool depthMap,
+                        Camera *&camera, SceneLoadStats& stats, std::string& error)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	stats.binary = isBinarySceneFile(path);
+	stats.outOfCore = false;
+	World *world;
+	if(stats.binary)
+	{
+		// Kept for the lifetime of the program: the world's objects point into the mapping
+		BinaryScene *scene = new BinaryScene;
+		if(!scene->open(path, error, sceneMemoryBudget))
+		{
+			delete scene;
+			return NULL;
+		}
+		stats.outOfCore = scene->isOutOfCore();
+		stats.numPrimitives = scene->getNumPrimitives();
+		stats.parseSeconds = secondsSince(start);
+
+		start = std::chrono::steady_clock::now();
+		camera = scene->createCamera(image_width, image_height, samplesPerPixel);
+		world = scene->buildWorld(camera, depthMap, compressMeshes);
+	}
+	else if(hasExtension(path, ".ply") && !compressMeshes)
+	{
+		// Kept for the lifetime of the program like a compiled scene; the mesh may point into its mapping
+		PLYMesh *mesh = new PLYMesh;
+		if(!mesh->open(path, error))
+		{
+			delete mesh;
+			return NULL;
+		}
+		stats.binary = mesh->isMapped();
+		stats.numPrimitives = mesh->getNumTriangles();
+		stats.parseSeconds = secondsSince(start);
+
+		start = std::chrono::steady_clock::now();
+		SceneDescription scene;
+		float lo[3], hi[3];
+		mesh->getBounds(lo, hi);
+		frameMesh(scene, lo, hi);
+		camera = createCamera(scene, image_width, image_height, samplesPerPixel);
+		world = createWorld(scene.background, depthMap);
+		std::vector<Material*> materials = createMaterials(world, camera, &plyMaterial, 1, depthMap);
+		addLights(world, scene.lights.data(), scene.lights.size());
+		world->addObject(mesh->createMesh(materials[0], camera));
+	}
+	else
+	{
+		SceneDescription scene;
+		bool ok = isMeshFile(path) ? importMeshScene(path, scene, error) : parseSceneFile(path, scene, error);
+		if(!ok)
+			return NULL;
+		stats.numPrimitives = scene.getNumPrimitives();
+		stats.parseSeconds = secondsSince(start);
+
+		start = std::chrono::steady_clock::now();
+		camera = createCamera(scene, image_width, image_height, samplesPerPixel);
+		world = buildWorld(scene, camera, depthMap, compressMeshes);
+	}
+	stats.buildSeconds = secondsSince(start);
+	addMeshStats(world, stats);
+	return world;
+}
+
+World* loadSceneFile(const char *path, int image_width, int image_height, int samplesPerPixel, bool depthMap,
+                     Camera *&camera, SceneLoadStats& stats, std::string& error)
+{
+	// Whatever was allocated before running out is not worth recovering: the caller exits
+	try
+	{
+		return loadScene(path, image_width, image_height, samplesPerPixel, depthMap, camera, stats, error);
+	}
+	catch(const std::bad_alloc&)
+	{
+		error = std::string(path) + ": out of memory while loading. Compile the scene and load the compiled file, "
+		        "which is rendered out of core.";
+		return NULL;
+	}
+}
+
+bool compileSceneFile(const char *textPath, const char *binaryPath, std::string& error)
+{
+	try
+	{
+		SceneDescription scene;
+		bool ok = isMeshFile(textPath) ? importMeshScene(textPath, scene, error) : parseSceneFile(textPath, scene, error);
+		if(!ok)
+			return false;
+		CompiledScene compiled;
+		compileScene(scene, compiled);
+		return writeBinaryScene(binaryPath, scene, compiled, error);
+	}
+	catch(const std::bad_alloc&)
+	{
+		error = std::string(textPath) + ": out of memory while compiling";
+		return false;
+	}
+}
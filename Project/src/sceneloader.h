@@ -0,0 +1,37 @@
+//sceneloader.h
+#ifndef _SCENELOADER_H_
+#define _SCENELOADER_H_
+
+#include <cstddef>
+#include <string>
+#include "world.h"
+#include "camera.h"
+
+struct SceneLoadStats
+{
+	bool binary;          // Used in place from a mapping (compiled scene or PLY) rather than parsed
+	std::size_t numPrimitives;
+	double parseSeconds;  // Reading and parsing the text, or mapping and checking a compiled scene
+	double buildSeconds;  // Creating the world, including BVH construction for text scenes
+	bool outOfCore;       // Compiled scene larger than the memory budget, paged in while rendering
+	std::size_t meshTriangles, meshBytes; // Storage of all meshes, BVHs included
+	float meshError;      // Largest vertex coordinate error of compressed meshes
+};
+
+// Memory a compiled scene may take before it is rendered out of core (see BinaryScene::open).
+// 0, the default, is half of physical memory.
+void setSceneMemoryBudget(std::size_t bytes);
+
+// Store the meshes of loaded scenes as CompressedMesh (off by default)
+void setMeshCompression(bool compress);
+
+// Loads a text or compiled scene file, whichever it is, creating its camera and world.
+// A path ending in .obj or .ply is loaded as a single mesh with a camera framing it.
+// Returns NULL and sets error on failure, including running out of memory.
+World* loadSceneFile(const char *path, int image_width, int image_height, int samplesPerPixel, bool depthMap,
+                     Camera *&camera, SceneLoadStats& stats, std::string& error);
+
+// Parses a text scene (or an OBJ or PLY file) and writes it as a compiled scene
+bool compileSceneFile(const char *textPath, const char *binaryPath, std::string& error);
+
+#endif
@@ -0,0 +1,20 @@
+//scenes.h
+#ifndef _SCENES_H_
+#define _SCENES_H_
+
+#include "world.h"
+#include "camera.h"
+#include "material.h"
+
+#define NUM_SCENES 9
+
+// Function to assign material
+Material* assignMaterial(World *world, Camera *camera, Color _color, float _ka, float _kd, float _ks, float _kr, float _kt, float _eta, float _C, int _n, bool _dp);
+
+// Camera shared by all built-in scenes
+Camera* createSceneCamera(int image_width, int image_height, int samplesPerPixel);
+
+// Build one of the built-in scenes (1 to NUM_SCENES) around the given camera
+World* buildScene(int choice2, Camera *camera, bool depthMap);
+
+#endif
@@ -17,7 +17,6 @@ bool Sphere::intersect(Ray& r) const
 
 		if(discriminant == 0)
 		{
-            camera->setIsRenderingObject(true);
 			double t;
 			t = -b/(2.0*a);
 			r.setParameter(t, this);
@@ -29,7 +28,6 @@ bool Sphere::intersect(Ray& r) const
 		}
 		else
 		{
-            camera->setIsRenderingObject(true);
 			//Calculate both roots
 			double D = sqrt(discriminant);
 			double t1 = (-b +D)/(2.0*a);
@@ -59,10 +57,6 @@ bool Sphere::intersect(Ray& r) const
             return b1||b2;
 		}
 	}
-    else
-    {
-        camera->setIsRenderingObject(false);
-    }
 	return false;
 
 }
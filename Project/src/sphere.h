@@ -15,11 +15,11 @@ private:
 
 public:
 	Sphere(const Vector3D& _pos, double _rad, Material* mat, Camera* cam):
-		Object(mat, cam), position(_pos), radius(_rad)
+		Object(mat, cam, SPHERE), position(_pos), radius(_rad)
 	{
 		isSolid = true;
 	}
 	
-	virtual bool intersect(Ray& r) const;
+	bool intersect(Ray& r) const;
 };
 #endif
@@ -0,0 +1,37 @@
+//sphereset.cpp
+
+#include "sphereset.h"
+
+bool SphereSet::intersect(Ray& r) const
+{
+	Vector3D o = r.getOrigin(), d = r.getDirection();
+	const float ox = o.X(), oy = o.Y(), oz = o.Z();
+	const float dx = d.X(), dy = d.Y(), dz = d.Z();
+	long hit = -1;
+
+	traverseBVH(nodes, r, [&](int first, int n) {
+		for(int k = first; k < first + n; k++)
+		{
+			// Same quadratic as Sphere::intersect, with a = 1 and b halved
+			float cx = ox - centerX[k], cy = oy - centerY[k], cz = oz - centerZ[k];
+			float b = dx*cx + dy*cy + dz*cz;
+			float c = cx*cx + cy*cy + cz*cz - radius[k]*radius[k];
+			float discriminant = b*b - c;
+			if(discriminant < 0.0f)
+				continue;
+			float D = sqrtf(discriminant);
+			// Nearest root in front of the origin; setParameter rejects anything behind the current hit
+			if(r.setParameter(-b - D, this) || r.setParameter(-b + D, this))
+				hit = k;
+		}
+	});
+
+	if(hit < 0)
+		return false;
+	r.setLevel(r.getLevel() + 1);
+	Vector3D center(centerX[hit], centerY[hit], centerZ[hit]);
+	Vector3D normal = center - r.getPosition();
+	normal.normalize();
+	r.setNormal(normal);
+	return true;
+}
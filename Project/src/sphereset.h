@@ -0,0 +1,31 @@
+//sphereset.h
+#ifndef _SPHERESET_H_
+#define _SPHERESET_H_
+
+#include <cstddef>
+#include "object.h"
+#include "bvh.h"
+
+// Many spheres sharing one material, stored as separate coordinate and radius arrays in BVH
+// leaf order. The set does not own its arrays: they live in a compiled scene or a mapped file.
+// Like Sphere, hits report the normal pointing towards the centre. The ray's level is raised
+// once per set hit instead of once per sphere the ray's line crosses.
+class SphereSet : public Object
+{
+private:
+	std::size_t count;
+	const float *centerX, *centerY, *centerZ, *radius;
+	const BVHNode *nodes;
+
+public:
+	SphereSet(std::size_t n, const float *x, const float *y, const float *z, const float *r,
+	          const BVHNode *bvh, Material* mat, Camera* cam):
+		Object(mat, cam, SPHERE_SET), count(n), centerX(x), centerY(y), centerZ(z), radius(r), nodes(bvh)
+	{
+		isSolid = true;
+	}
+
+	std::size_t getCount() const {return count;}
+	bool intersect(Ray& r) const;
+};
+#endif
@@ -1,6 +1,6 @@
 //transformedSurface.cpp
 
-#include "transformedSurface.h"
+#include "primitives.h"
 
 bool TransformedSurface::intersect(Ray& r) const
 {
@@ -11,18 +11,13 @@ bool TransformedSurface::intersect(Ray& r) const
     r.transform(invTransform);
 
     // Call the intersect function of the original surface
-    bool hit = surface->intersect(r);
+    bool hit = intersectObject(surface, r);
 
     if (hit)
     {
-        camera->setIsRenderingObject(true);
         // Transform the intersection point and normal back to global coordinates
         r.transform(*transform);
     }
-    else
-    {
-        camera->setIsRenderingObject(false);
-    }
 
     return hit;
 }
\ No newline at end of file
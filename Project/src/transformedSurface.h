@@ -15,12 +15,12 @@ private:
 public:
     TransformMatrix* transform;
     TransformedSurface(Object* obj, TransformMatrix* trans, Material* mat, Camera* cam) :
-            Object(mat, cam), surface(obj), transform(trans)
+            Object(mat, cam, TRANSFORMED_SURFACE), surface(obj), transform(trans)
     {
         isSolid = true;
     }
 
-    virtual bool intersect(Ray& r) const;
+    bool intersect(Ray& r) const;
 };
 
 #endif
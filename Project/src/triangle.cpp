@@ -12,10 +12,7 @@ bool Triangle::intersect(Ray& r) const
 
     // Check if the ray is parallel to the triangle
     if (a > -SMALLEST_DIST && a < SMALLEST_DIST)
-    {
-        camera->setIsRenderingObject(false);
         return false;
-    }
 
     double f = 1.0 / a;
     Vector3D s = r.getOrigin() - vertex1;
@@ -42,17 +39,8 @@ bool Triangle::intersect(Ray& r) const
             Vector3D normal = crossProduct(edge2, edge1);
             normal.normalize();
             r.setNormal(normal);
-            camera->setIsRenderingObject(true);
             return true;
         }
-        else
-        {
-            camera->setIsRenderingObject(false);
-        }
-    }
-    else
-    {
-        camera->setIsRenderingObject(false);
     }
 
     return false;
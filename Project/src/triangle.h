@@ -17,11 +17,11 @@ private:
 
 public:
     Triangle(const Vector3D& v1, const Vector3D& v2, const Vector3D& v3, Material* mat, Camera* cam) :
-            Object(mat, cam), vertex1(v1), vertex2(v2), vertex3(v3)
+            Object(mat, cam, TRIANGLE), vertex1(v1), vertex2(v2), vertex3(v3)
     {
         isSolid = true;
     }
 
-    virtual bool intersect(Ray& r) const;
+    bool intersect(Ray& r) const;
 };
 #endif
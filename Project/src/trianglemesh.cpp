@@ -0,0 +1,57 @@
+//trianglemesh.cpp
+
+#include "trianglemesh.h"
+#include <cstring>
+
+bool TriangleMesh::intersect(Ray& r) const
+{
+	const Vector3D o = r.getOrigin(), d = r.getDirection();
+	long hit = -1;
+	Vector3D hitEdge1, hitEdge2;
+
+	traverseBVH(nodes, r, [&](int first, int n) {
+		for(int k = first; k < first + n; k++)
+		{
+			// memcpy because strided records need not be aligned; for packed arrays it is a plain load
+			int idx[3];
+			float v1[3], v2[3], v3[3];
+			std::memcpy(idx, indices + (order ? order[k] : k) * indexStride, sizeof(idx));
+			std::memcpy(v1, vertices + idx[0] * vertexStride, sizeof(v1));
+			std::memcpy(v2, vertices + idx[1] * vertexStride, sizeof(v2));
+			std::memcpy(v3, vertices + idx[2] * vertexStride, sizeof(v3));
+			Vector3D vertex1(v1[0], v1[1], v1[2]);
+			Vector3D edge1 = Vector3D(v2[0], v2[1], v2[2]) - vertex1;
+			Vector3D edge2 = Vector3D(v3[0], v3[1], v3[2]) - vertex1;
+
+			// Moller-Trumbore, as in Triangle::intersect
+			Vector3D h = crossProduct(d, edge2);
+			float a = dotProduct(edge1, h);
+			if(a > -SMALLEST_DIST && a < SMALLEST_DIST)
+				continue;
+			float f = 1.0f / a;
+			Vector3D s = o - vertex1;
+			float beta = f * dotProduct(s, h);
+			if(beta <= 0.0f || beta >= 1.0f)
+				continue;
+			Vector3D q = crossProduct(s, edge1);
+			float gamma = f * dotProduct(d, q);
+			if(gamma <= 0.0f || beta + gamma >= 1.0f)
+				continue;
+
+			if(r.setParameter(f * dotProduct(edge2, q), this))
+			{
+				hit = k;
+				hitEdge1 = edge1;
+				hitEdge2 = edge2;
+			}
+		}
+	});
+
+	if(hit < 0)
+		return false;
+	r.setLevel(r.getLevel() + 1);
+	Vector3D normal = crossProduct(hitEdge2, hitEdge1);
+	normal.normalize();
+	r.setNormal(normal);
+	return true;
+}
@@ -0,0 +1,54 @@
+//trianglemesh.h
+#ifndef _TRIANGLEMESH_H_
+#define _TRIANGLEMESH_H_
+
+#include <cstddef>
+#include "object.h"
+#include "bvh.h"
+
+// Indexed triangle mesh with one material. Vertices are xyz floats and every triangle is three
+// vertex indices; triangles are stored in BVH leaf order. The mesh does not own its arrays:
+// they live in a compiled scene or a mapped file. Hits match Triangle: only the interior of a
+// triangle counts and the normal is crossProduct(edge2, edge1).
+//
+// Vertices and triangles may also be records of a larger, possibly unaligned, byte stride, so
+// that a mapped file can be used as it is. Such a mesh keeps its triangles in file order and
+// reaches them through 'order', the BVH's leaf order.
+class TriangleMesh : public Object
+{
+private:
+	std::size_t numVertices, numTriangles;
+	const char *vertices, *indices;
+	std::size_t vertexStride, indexStride; // In bytes
+	const unsigned *order;                 // NULL if the triangles are in leaf order
+	const BVHNode *nodes;
+	std::size_t numNodes;
+
+public:
+	TriangleMesh(std::size_t nv, const float *v, std::size_t nt, const int *idx, const BVHNode *bvh, std::size_t nn,
+	             Material* mat, Camera* cam):
+		Object(mat, cam, MESH), numVertices(nv), numTriangles(nt), vertices((const char*)v), indices((const char*)idx),
+		vertexStride(3 * sizeof(float)), indexStride(3 * sizeof(int)), order(NULL), nodes(bvh), numNodes(nn)
+	{
+		isSolid = true;
+	}
+
+	TriangleMesh(std::size_t nv, const void *v, std::size_t vStride, std::size_t nt, const void *idx, std::size_t iStride,
+	             const unsigned *leafOrder, const BVHNode *bvh, std::size_t nn, Material* mat, Camera* cam):
+		Object(mat, cam, MESH), numVertices(nv), numTriangles(nt), vertices((const char*)v), indices((const char*)idx),
+		vertexStride(vStride), indexStride(iStride), order(leafOrder), nodes(bvh), numNodes(nn)
+	{
+		isSolid = true;
+	}
+
+	std::size_t getNumVertices() const {return numVertices;}
+	std::size_t getNumTriangles() const {return numTriangles;}
+	// Bytes of the arrays the mesh reads, including the BVH, wherever they live
+	std::size_t getMemoryUsage() const
+	{
+		return sizeof(*this) + numVertices * vertexStride + numTriangles * (indexStride + (order ? sizeof(unsigned) : 0)) +
+		       numNodes * sizeof(BVHNode);
+	}
+	bool intersect(Ray& r) const;
+};
+#endif
@@ -2,49 +2,125 @@
 #ifndef _VECTOR_H_
 #define _VECTOR_H_
 #include<math.h>
-class Vector3D
+#include<assert.h>
+
+// Scalar precision of the renderer. Float is the default: it halves memory traffic and
+// doubles SIMD width. Define RAYTRACER_DOUBLE_PRECISION to get doubles for precision checks.
+#ifdef RAYTRACER_DOUBLE_PRECISION
+typedef double Real;
+#else
+typedef float Real;
+#endif
+
+// Define RAYTRACER_VECTOR4 to store vectors as 4 aligned lanes (the 4th lane is kept at zero),
+// so the element-wise operators map onto single SIMD instructions.
+#ifdef RAYTRACER_VECTOR4
+#define VECTOR3D_LANES 4
+#else
+#define VECTOR3D_LANES 3
+#endif
+
+// Header-only so every operator can be inlined across translation units.
+template<typename T, int N = 3>
+class alignas(N == 4 ? 4 * sizeof(T) : sizeof(T)) Vector3T
 {
+	static_assert(N == 3 || N == 4, "Vector3T stores either 3 or 4 lanes");
+
 public:
-	Vector3D() {}
-	Vector3D(double e0, double e1, double e2);
-	Vector3D(const Vector3D &v) {*this = v;}
+	typedef T Scalar;
 
-	double X() const{ return e[0];}
-	double Y() const{ return e[1];}
-	double Z() const{ return e[2];}
+	Vector3T() { if (N == 4) e[N - 1] = 0; }
+	Vector3T(T e0, T e1, T e2)
+	{
+		e[0] = e0; e[1] = e1; e[2] = e2;
+		if (N == 4) e[N - 1] = 0;
+	}
+	Vector3T(const Vector3T &v) = default;
+	Vector3T& operator=(const Vector3T &v) = default;
 
-	void X(double x) {e[0] = x;}
-	void Y(double y) {e[1] = y;}
-	void Z(double z) {e[2] = z;}
+	// Converting constructor between precisions
+	template<typename U, int M>
+	explicit Vector3T(const Vector3T<U, M> &v) : Vector3T(T(v.X()), T(v.Y()), T(v.Z())) {}
+
+	T X() const{ return e[0];}
+	T Y() const{ return e[1];}
+	T Z() const{ return e[2];}
+
+	void X(T x) {e[0] = x;}
+	void Y(T y) {e[1] = y;}
+	void Z(T z) {e[2] = z;}
 
 	//define operators
-	const Vector3D& operator+() const;
-	Vector3D operator-() const;
-	double operator[](int i) const {return e[i];}
-	double& operator[](int i) {return e[i];}
-
-	friend bool operator==(const Vector3D& v1, const Vector3D& v2);
-	friend bool operator!=(const Vector3D& v1, const Vector3D& v2);
-	friend Vector3D operator+(const Vector3D& v1, const Vector3D& v2);
-	friend Vector3D operator-(const Vector3D& v1, const Vector3D& v2);
-	friend Vector3D operator/(const Vector3D& v, double scalar);
-	friend Vector3D operator*(const Vector3D& v, double scalar);
-	friend Vector3D operator*(double scalar, const Vector3D& v);
-	Vector3D& operator+=(const Vector3D &v);
-	Vector3D& operator-=(const Vector3D &v);
-	Vector3D& operator*=(double scalar);
-	Vector3D& operator/=(double scalar);
+	const Vector3T& operator+() const {return *this;}
+	Vector3T operator-() const
+	{
+		Vector3T tmp;
+		for (int i = 0; i < N; i++) tmp.e[i] = -e[i];
+		return tmp;
+	}
+	T operator[](int i) const {return e[i];}
+	T& operator[](int i) {return e[i];}
+
+	friend bool operator==(const Vector3T& v1, const Vector3T& v2)
+	{
+		return v1.e[0] == v2.e[0] && v1.e[1] == v2.e[1] && v1.e[2] == v2.e[2];
+	}
+	friend bool operator!=(const Vector3T& v1, const Vector3T& v2) {return !(v1==v2);}
+	friend Vector3T operator+(const Vector3T& v1, const Vector3T& v2) {Vector3T tmp(v1); return tmp += v2;}
+	friend Vector3T operator-(const Vector3T& v1, const Vector3T& v2) {Vector3T tmp(v1); return tmp -= v2;}
+	friend Vector3T operator/(const Vector3T& v, T scalar)
+	{
+		Vector3T tmp;
+		for (int i = 0; i < N; i++) tmp.e[i] = v.e[i] / scalar;
+		return tmp;
+	}
+	friend Vector3T operator*(const Vector3T& v, T scalar) {Vector3T tmp(v); return tmp *= scalar;}
+	friend Vector3T operator*(T scalar, const Vector3T& v) {Vector3T tmp(v); return tmp *= scalar;}
+
+	Vector3T& operator+=(const Vector3T &v)
+	{
+		for (int i = 0; i < N; i++) e[i] += v.e[i];
+		return *this;
+	}
+	Vector3T& operator-=(const Vector3T &v)
+	{
+		for (int i = 0; i < N; i++) e[i] -= v.e[i];
+		return *this;
+	}
+	Vector3T& operator*=(T scalar)
+	{
+		for (int i = 0; i < N; i++) e[i] *= scalar;
+		return *this;
+	}
+	Vector3T& operator/=(T scalar)
+	{
+		assert(scalar != 0);
+		T inv = T(1)/scalar;
+		return *this *= inv;
+	}
 
 	//Vector3D functions
-	double length() const;
-	double squaredlength() const;
-	void normalize();
-	friend Vector3D unitVector(const Vector3D& v);
-	friend Vector3D crossProduct(const Vector3D& v1, const Vector3D& v2);
-	friend double dotProduct(const Vector3D& v1, const Vector3D& v2);
-	friend double tripleProduct(const Vector3D& v1,const Vector3D& v2,const Vector3D& v3);
+	T length() const { return sqrt(squaredlength()); }
+	T squaredlength() const { return e[0]*e[0] + e[1]*e[1] + e[2]*e[2]; }
+	void normalize() { *this = *this / length(); }
+
+	friend Vector3T unitVector(const Vector3T& v) { return v / v.length(); }
+	friend Vector3T crossProduct(const Vector3T& v1, const Vector3T& v2)
+	{
+		return Vector3T(v1.Y() * v2.Z() - v1.Z() * v2.Y(),
+		                v1.Z() * v2.X() - v1.X() * v2.Z(),
+		                v1.X() * v2.Y() - v1.Y() * v2.X());
+	}
+	friend T dotProduct(const Vector3T& v1, const Vector3T& v2)
+	{ return v1.X()*v2.X() + v1.Y()*v2.Y() + v1.Z()*v2.Z(); }
+	friend T tripleProduct(const Vector3T& v1,const Vector3T& v2,const Vector3T& v3)
+	{ return dotProduct(crossProduct(v1, v2), v3); }
 
 	//data member
-	double e[3];
+	T e[N];
 };
+
+typedef Vector3T<Real, VECTOR3D_LANES> Vector3D;
+typedef Vector3T<double, 3> Vector3Dd;
+typedef Vector3T<float, 3> Vector3Df;
 #endif
@@ -1,11 +1,12 @@
 #include "world.h"
+#include "primitives.h"
 
 using namespace std;
 
 float World::firstIntersection(Ray& ray)
 {
 	for(int i=0; i<objectList.size(); i++)
-		objectList[i]->intersect(ray);
+		intersectObject(objectList[i], ray);
 	return ray.getParameter();
 }
 
@@ -12,13 +12,14 @@ class World
 private:
 	std::vector<Object*> objectList;
 	std::vector<LightSource*> lightSourceList;
+	std::vector<Material*> materialList; // Distinct materials, in the order objects first used them
 
 	Color ambient;
 	Color background; //Background color to shade rays that miss all objects
 
 public:
 	World():
-		objectList(0), lightSourceList(0), ambient(0), background(0)
+		objectList(0), lightSourceList(0), materialList(0), ambient(0), background(0)
 	{}
 	void setBackground(const Color& bk) { background = bk;}
 	Color getBackground() { return background;}
@@ -30,6 +31,13 @@ public:
 	}
 	void addObject(Object *obj)
 	{
+		obj->setId(objectList.size());
+		Material *mat = obj->getMaterial();
+		if(mat && mat->id < 0)
+		{
+			mat->id = materialList.size();
+			materialList.push_back(mat);
+		}
 		objectList.push_back(obj);
 	}
     const std::vector<LightSource*>& getLightSources() const
@@ -40,6 +48,10 @@ public:
     {
         return objectList;
     }
+    const std::vector<Material*>& getMaterialList() const
+    {
+        return materialList;
+    }
     float firstIntersection(Ray& ray);
 	Color shade_ray(Ray& ray);
 };